@@ -0,0 +1,63 @@
+/**
+ * @file button_debounce.h
+ * @brief Edge-triggered, timer-settled push button debouncer
+ *
+ * The first edge of a burst arms one settle timer; further edges are ignored
+ * until it fires. When it fires the line is sampled once and an event is
+ * reported only if the level differs from the last accepted one. A bounce
+ * that outlasts the settle time just produces another edge, which arms the
+ * timer again, so the accepted level always converges on the real one.
+ *
+ * on_edge() may run in interrupt context, on_settled() in the thread the
+ * timer callback is dispatched on. on_settled() clears the pending flag
+ * before sampling, so an edge racing with the sample always re-arms.
+ *
+ * Header-only and free of mbed dependencies so it builds on the host; the
+ * level is read through a callable, so a simulated bouncing line can drive
+ * it directly.
+ */
+
+#ifndef BUTTON_DEBOUNCE_H
+#define BUTTON_DEBOUNCE_H
+
+#include <atomic>
+
+enum ButtonEvent { BUTTON_NONE, BUTTON_PRESSED, BUTTON_RELEASED };
+
+class ButtonDebouncer {
+public:
+  explicit ButtonDebouncer(bool pressed = false)
+      : pressed_(pressed), settling_(false) {}
+
+  /**
+   * Edge interrupt. Returns true when the caller has to arm the settle
+   * timer, false while one is already pending.
+   */
+  bool on_edge() {
+    return !settling_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  /**
+   * Settle timer expired. @p read_pressed returns true while the button is
+   * held; it is called exactly once.
+   */
+  template <typename ReadFn> ButtonEvent on_settled(ReadFn read_pressed) {
+    settling_.store(false, std::memory_order_release);
+    bool level = read_pressed();
+    if (level == pressed_)
+      return BUTTON_NONE;
+    pressed_ = level;
+    return level ? BUTTON_PRESSED : BUTTON_RELEASED;
+  }
+
+  /** Last accepted level. */
+  bool pressed() const { return pressed_; }
+
+  bool settling() const { return settling_.load(std::memory_order_relaxed); }
+
+private:
+  bool pressed_;                // owned by the on_settled() context
+  std::atomic<bool> settling_; // settle timer armed
+};
+
+#endif // BUTTON_DEBOUNCE_H
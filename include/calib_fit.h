@@ -0,0 +1,204 @@
+/**
+ * @file calib_fit.h
+ * @brief Least-squares calibration fit over many (raw, diameter) points
+ *
+ * Fits mm = c0 + c1 * d + c2 * d^2 with d = raw - center (degree 1 drops
+ * the square term) to up to CALIB_FIT_MAX_POINTS points and reports the
+ * residual of every point, the RMS and largest residual and R^2.
+ *
+ * The normal equations are set up in a centered and scaled abscissa
+ * (u = d / scale, |u| <= 1) and centered diameters, which keeps them well
+ * conditioned in single precision, and solved by Gaussian elimination with
+ * partial pivoting. The work is a fixed number of float operations per point
+ * plus one 3x3 solve, so the time is bounded by CALIB_FIT_MAX_POINTS.
+ *
+ * A fit is refused if it is underdetermined, singular (too few distinct raw
+ * values) or not monotonic over the raw range of its points, since the
+ * conversion and its inverse assume a monotonic curve.
+ *
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef CALIB_FIT_H
+#define CALIB_FIT_H
+
+#include <math.h>
+#include <stdint.h>
+
+#ifndef CALIB_FIT_MAX_POINTS
+#define CALIB_FIT_MAX_POINTS 16
+#endif
+#define CALIB_FIT_MAX_DEGREE 2
+
+/* CalibFitResult::status */
+#define CALIB_FIT_OK 0
+#define CALIB_FIT_TOO_FEW 1       // fewer points than degree + 2
+#define CALIB_FIT_SINGULAR 2      // raw values not distinct enough
+#define CALIB_FIT_NOT_MONOTONIC 3 // slope changes sign within the data
+#define CALIB_FIT_BAD_DEGREE 4
+
+struct CalibFitPoint {
+  uint16_t raw;
+  float mm;
+};
+
+struct CalibFitResult {
+  uint8_t status; // CALIB_FIT_*
+  uint8_t degree;
+  uint8_t count;
+  uint16_t raw_min; // raw range of the points, where the curve is
+  uint16_t raw_max; // checked to be monotonic
+  float center;     // raw value the polynomial is expanded around
+  float coeff[3]; // c0, c1 (mm/count), c2 (mm/count^2)
+  float residual[CALIB_FIT_MAX_POINTS]; // measured - fitted, mm
+  float rms_mm;
+  float max_abs_mm;
+  float r2;
+};
+
+/** Evaluates a fitted polynomial at @p raw. */
+static inline float calib_fit_eval(const CalibFitResult &fit, float raw) {
+  float d = raw - fit.center;
+  return fit.coeff[0] + d * (fit.coeff[1] + d * fit.coeff[2]);
+}
+
+// Solves the n x n system m * x = v in place (n <= 3). Returns false if a
+// pivot vanishes relative to the matrix scale.
+static inline bool calib_fit_solve(float m[3][3], float v[3], float x[3],
+                                   int n) {
+  float scale = 0.0f;
+  for (int i = 0; i < n; i++)
+    scale = fabsf(m[i][i]) > scale ? fabsf(m[i][i]) : scale;
+  if (scale == 0.0f)
+    return false;
+
+  for (int col = 0; col < n; col++) {
+    int piv = col;
+    for (int r = col + 1; r < n; r++)
+      if (fabsf(m[r][col]) > fabsf(m[piv][col]))
+        piv = r;
+    if (fabsf(m[piv][col]) < 1e-6f * scale)
+      return false;
+    if (piv != col) {
+      for (int c = 0; c < n; c++) {
+        float t = m[col][c];
+        m[col][c] = m[piv][c];
+        m[piv][c] = t;
+      }
+      float t = v[col];
+      v[col] = v[piv];
+      v[piv] = t;
+    }
+    for (int r = col + 1; r < n; r++) {
+      float f = m[r][col] / m[col][col];
+      for (int c = col; c < n; c++)
+        m[r][c] -= f * m[col][c];
+      v[r] -= f * v[col];
+    }
+  }
+  for (int r = n - 1; r >= 0; r--) {
+    float s = v[r];
+    for (int c = r + 1; c < n; c++)
+      s -= m[r][c] * x[c];
+    x[r] = s / m[r][r];
+  }
+  return true;
+}
+
+/**
+ * Fits a polynomial of @p degree (1 or 2) to @p n points. The residuals and
+ * statistics are filled in only if status is CALIB_FIT_OK.
+ */
+static inline void calib_fit(const CalibFitPoint *pts, uint8_t n,
+                             uint8_t degree, CalibFitResult *out) {
+  out->degree = degree;
+  out->count = n;
+  out->coeff[0] = out->coeff[1] = out->coeff[2] = 0.0f;
+  if (degree < 1 || degree > CALIB_FIT_MAX_DEGREE) {
+    out->status = CALIB_FIT_BAD_DEGREE;
+    return;
+  }
+  if (n < degree + 2 || n > CALIB_FIT_MAX_POINTS) {
+    out->status = CALIB_FIT_TOO_FEW;
+    return;
+  }
+
+  // Center and scale the abscissa, center the diameters.
+  uint32_t raw_sum = 0;
+  uint16_t raw_min = 0xFFFF, raw_max = 0;
+  float mm_sum = 0.0f;
+  for (uint8_t i = 0; i < n; i++) {
+    raw_sum += pts[i].raw;
+    raw_min = pts[i].raw < raw_min ? pts[i].raw : raw_min;
+    raw_max = pts[i].raw > raw_max ? pts[i].raw : raw_max;
+    mm_sum += pts[i].mm;
+  }
+  out->raw_min = raw_min;
+  out->raw_max = raw_max;
+  float center = (float)raw_sum / (float)n;
+  float mm_mean = mm_sum / (float)n;
+  float lo = center - (float)raw_min, hi = (float)raw_max - center;
+  float scale = hi > lo ? hi : lo;
+  if (scale < 1.0f) {
+    out->status = CALIB_FIT_SINGULAR;
+    return;
+  }
+
+  // Normal equations: sum u^(i+j) * a_j = sum u^i * y.
+  int k = degree + 1;
+  float pw[5] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  float rhs[3] = {0.0f, 0.0f, 0.0f};
+  for (uint8_t i = 0; i < n; i++) {
+    float u = ((float)pts[i].raw - center) / scale;
+    float y = pts[i].mm - mm_mean;
+    float up = 1.0f;
+    for (int e = 0; e <= 2 * degree; e++) {
+      pw[e] += up;
+      if (e < k)
+        rhs[e] += up * y;
+      up *= u;
+    }
+  }
+  float m[3][3];
+  for (int i = 0; i < k; i++)
+    for (int j = 0; j < k; j++)
+      m[i][j] = pw[i + j];
+  float a[3] = {0.0f, 0.0f, 0.0f};
+  if (!calib_fit_solve(m, rhs, a, k)) {
+    out->status = CALIB_FIT_SINGULAR;
+    return;
+  }
+
+  out->center = center;
+  out->coeff[0] = a[0] + mm_mean;
+  out->coeff[1] = a[1] / scale;
+  out->coeff[2] = a[2] / (scale * scale);
+
+  // Slope at both ends of the data must have the same sign.
+  float c2x2 = 2.0f * out->coeff[2];
+  float s_lo = out->coeff[1] + c2x2 * ((float)raw_min - center);
+  float s_hi = out->coeff[1] + c2x2 * ((float)raw_max - center);
+  if (s_lo * s_hi <= 0.0f) {
+    out->status = CALIB_FIT_NOT_MONOTONIC;
+    return;
+  }
+
+  float ss_res = 0.0f, ss_tot = 0.0f, max_abs = 0.0f;
+  for (uint8_t i = 0; i < n; i++) {
+    float r = pts[i].mm - calib_fit_eval(*out, (float)pts[i].raw);
+    float t = pts[i].mm - mm_mean;
+    out->residual[i] = r;
+    ss_res += r * r;
+    ss_tot += t * t;
+    max_abs = fabsf(r) > max_abs ? fabsf(r) : max_abs;
+  }
+  out->rms_mm = sqrtf(ss_res / (float)n);
+  out->max_abs_mm = max_abs;
+  if (ss_tot > 0.0f)
+    out->r2 = 1.0f - ss_res / ss_tot;
+  else
+    out->r2 = ss_res > 0.0f ? 0.0f : 1.0f; // all diameters equal
+  out->status = CALIB_FIT_OK;
+}
+
+#endif // CALIB_FIT_H
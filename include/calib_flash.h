@@ -0,0 +1,53 @@
+/**
+ * @file calib_flash.h
+ * @brief Internal-flash backend for CalibStore (STM32F446 sectors 6 and 7)
+ *
+ * The two 128 KiB sectors at the top of the 512 KiB flash are reserved for
+ * the calibration log; mbed_app.json limits the application image to the
+ * lower 256 KiB accordingly.
+ *
+ * A sector erase stalls instruction fetch from flash, and with it the I2C
+ * ISR and acquisition, for up to ~2 s. One is needed each time a sector
+ * fills up: every ~215 saves with the current 608-byte record (131072 /
+ * record size; main.cpp asserts the payload size this assumes). main.cpp
+ * erases the spare sector at boot and when the bus has been idle, so a
+ * save rarely erases inline. During an erase the watchdog supervisor is
+ * suspended and the extended pages report EXT_STATUS_FLASH_BUSY.
+ */
+
+#ifndef CALIB_FLASH_H
+#define CALIB_FLASH_H
+
+#include "mbed.h"
+
+#ifndef CALIB_FLASH_SECTOR_A_ADDR
+#define CALIB_FLASH_SECTOR_A_ADDR 0x08040000UL // sector 6
+#endif
+#ifndef CALIB_FLASH_SECTOR_B_ADDR
+#define CALIB_FLASH_SECTOR_B_ADDR 0x08060000UL // sector 7
+#endif
+#define CALIB_FLASH_SECTOR_SIZE (128UL * 1024UL)
+
+/* Watchdog allowance for one 128 KiB erase (datasheet max 2 s at x32). */
+#define CALIB_FLASH_ERASE_MAX_MS 4000
+
+class CalibFlashIAP {
+public:
+  bool init();
+
+  uint32_t sector_size() const { return CALIB_FLASH_SECTOR_SIZE; }
+  bool read(uint8_t sector, uint32_t offset, void *buf, uint32_t len);
+  bool program(uint8_t sector, uint32_t offset, const void *buf,
+               uint32_t len);
+  bool erase(uint8_t sector);
+
+private:
+  static uint32_t address(uint8_t sector, uint32_t offset) {
+    return (sector ? CALIB_FLASH_SECTOR_B_ADDR : CALIB_FLASH_SECTOR_A_ADDR) +
+           offset;
+  }
+
+  FlashIAP flash_;
+};
+
+#endif // CALIB_FLASH_H
@@ -0,0 +1,264 @@
+/**
+ * @file calib_store.h
+ * @brief Append-only, CRC-checked record log over two flash sectors
+ *
+ * Records are appended to the active sector until it is full; the next save
+ * continues in the other (spare) sector, erasing it first unless it is
+ * known to be blank. erase_spare() lets the caller do that erase ahead of
+ * time, when a stall suits it. The newest valid record (by sequence number)
+ * wins on mount, so at any point in time one complete record survives a
+ * power loss:
+ * - a record torn while its payload is programmed fails its CRC and is
+ *   skipped; the log continues behind it,
+ * - a torn header (implausible length) closes the rest of that sector,
+ * - an interrupted erase only affects the sector that holds no newer data.
+ *
+ * Record layout, 4-byte aligned:
+ *   magic u16 | format u8 | reserved u8 | length u16 | crc u16 | seq u32 |
+ *   payload[length]
+ * The CRC-16/CCITT-FALSE covers magic..length, seq and the payload. The
+ * header is programmed before the payload.
+ *
+ * The backend provides two equally sized sectors addressed by index:
+ *   uint32_t sector_size() const;
+ *   bool read(uint8_t sector, uint32_t offset, void *buf, uint32_t len);
+ *   bool program(uint8_t sector, uint32_t offset, const void *buf,
+ *                uint32_t len);
+ *   bool erase(uint8_t sector);
+ * Erased bytes must read as 0xFF.
+ *
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef CALIB_STORE_H
+#define CALIB_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CALIB_RECORD_MAGIC 0xCA1BU
+#define CALIB_RECORD_MAX_PAYLOAD 1024
+
+struct __attribute__((packed)) CalibRecordHeader {
+  uint16_t magic;
+  uint8_t format; // payload format, defined by the user of the store
+  uint8_t reserved;
+  uint16_t length; // payload bytes
+  uint16_t crc;
+  uint32_t seq;
+};
+
+static inline uint16_t calib_crc16_update(uint16_t crc, const void *data,
+                                          size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)p[i] << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                           : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+template <typename Backend> class CalibStore {
+public:
+  explicit CalibStore(Backend &flash)
+      : flash_(flash), mounted_(false), found_(false), spare_erased_(false),
+        active_(0), free_offset_(0), newest_offset_(0), seq_(0),
+        erases_(0) {
+    memset(&newest_, 0, sizeof(newest_));
+  }
+
+  /**
+   * Scans both sectors and blank-checks the spare. Returns true if a valid
+   * record was found.
+   */
+  bool mount() {
+    found_ = false;
+    seq_ = 0;
+    uint32_t free_off[2];
+    for (uint8_t s = 0; s < 2; s++)
+      free_off[s] = scan_sector(s);
+
+    active_ = found_ ? active_ : 0;
+    free_offset_ = free_off[active_];
+    spare_erased_ = sector_blank((uint8_t)(active_ ^ 1));
+    mounted_ = true;
+    return found_;
+  }
+
+  /**
+   * Copies the newest record into @p payload if it has @p format and
+   * exactly @p len bytes.
+   */
+  bool load(uint8_t format, void *payload, uint16_t len) {
+    if (!found_ || newest_.format != format || newest_.length != len)
+      return false;
+    return flash_.read(active_, newest_offset_ + sizeof(CalibRecordHeader),
+                       payload, len);
+  }
+
+  /** Appends a record; erases the other sector when the active one is full. */
+  bool save(uint8_t format, const void *payload, uint16_t len) {
+    if (!mounted_ || len > CALIB_RECORD_MAX_PAYLOAD)
+      return false;
+
+    uint32_t size = record_size(len);
+    uint8_t sector = active_;
+    uint32_t offset = free_offset_;
+    bool switching = offset + size > flash_.sector_size();
+    if (switching) {
+      if (!erase_spare())
+        return false;
+      sector = (uint8_t)(active_ ^ 1);
+      offset = 0;
+    }
+
+    CalibRecordHeader hdr;
+    hdr.magic = CALIB_RECORD_MAGIC;
+    hdr.format = format;
+    hdr.reserved = 0xFF;
+    hdr.length = len;
+    hdr.seq = seq_ + 1;
+    hdr.crc = record_crc(hdr, payload);
+
+    // Whatever happens from here on, this slot is consumed. The other
+    // sector only becomes active once the record is in it: until then the
+    // full one still holds the newest record, and the other one, written
+    // to now, is a dirty spare. After the switch the full one is.
+    if (switching)
+      spare_erased_ = false;
+    else
+      free_offset_ = offset + size;
+    if (!flash_.program(sector, offset, &hdr, sizeof(hdr)) ||
+        !flash_.program(sector, offset + sizeof(hdr), payload, len))
+      return false;
+
+    active_ = sector;
+    free_offset_ = offset + size;
+    seq_ = hdr.seq;
+    newest_ = hdr;
+    newest_offset_ = offset;
+    found_ = true;
+    return true;
+  }
+
+  /**
+   * Erases the spare sector unless it is known to be blank. The active
+   * sector holds the newest record, so this never loses data.
+   */
+  bool erase_spare() {
+    if (!mounted_)
+      return false;
+    if (spare_erased_)
+      return true;
+    erases_++;
+    spare_erased_ = flash_.erase((uint8_t)(active_ ^ 1));
+    return spare_erased_;
+  }
+
+  /** True if the spare sector still has to be erased before it is used. */
+  bool spare_dirty() const { return mounted_ && !spare_erased_; }
+
+  /** True if saving @p len bytes now would erase a sector first. */
+  bool save_erases(uint16_t len) const {
+    return spare_dirty() &&
+           free_offset_ + record_size(len) > flash_.sector_size();
+  }
+
+  bool has_record() const { return found_; }
+  uint32_t seq() const { return seq_; }
+  uint8_t active_sector() const { return active_; }
+  uint32_t free_bytes() const { return flash_.sector_size() - free_offset_; }
+  uint32_t erases() const { return erases_; }
+
+  static uint32_t record_size(uint16_t len) {
+    return (sizeof(CalibRecordHeader) + len + 3U) & ~3U;
+  }
+
+private:
+  static uint16_t record_crc(const CalibRecordHeader &hdr,
+                             const void *payload) {
+    uint16_t crc = calib_crc16_update(0xFFFF, &hdr, 6);
+    crc = calib_crc16_update(crc, &hdr.seq, sizeof(hdr.seq));
+    return calib_crc16_update(crc, payload, hdr.length);
+  }
+
+  // Walks the log of one sector, tracking the newest valid record across
+  // sectors. Returns the offset where the next record can be appended.
+  uint32_t scan_sector(uint8_t sector) {
+    uint32_t off = 0;
+    uint32_t size = flash_.sector_size();
+    while (off + sizeof(CalibRecordHeader) <= size) {
+      CalibRecordHeader hdr;
+      if (!flash_.read(sector, off, &hdr, sizeof(hdr)))
+        return size;
+      if (is_erased(&hdr, sizeof(hdr)))
+        return off;
+      if (hdr.magic != CALIB_RECORD_MAGIC ||
+          hdr.length > CALIB_RECORD_MAX_PAYLOAD ||
+          off + record_size(hdr.length) > size)
+        return size; // torn header: nothing behind it can be trusted
+
+      if (payload_valid(sector, off, hdr) && (!found_ || hdr.seq > seq_)) {
+        found_ = true;
+        seq_ = hdr.seq;
+        newest_ = hdr;
+        newest_offset_ = off;
+        active_ = sector;
+      }
+      off += record_size(hdr.length);
+    }
+    return size;
+  }
+
+  bool payload_valid(uint8_t sector, uint32_t off,
+                     const CalibRecordHeader &hdr) {
+    uint16_t crc = calib_crc16_update(0xFFFF, &hdr, 6);
+    crc = calib_crc16_update(crc, &hdr.seq, sizeof(hdr.seq));
+    uint8_t chunk[32];
+    uint32_t pos = off + sizeof(hdr);
+    for (uint32_t left = hdr.length; left > 0;) {
+      uint32_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+      if (!flash_.read(sector, pos, chunk, n))
+        return false;
+      crc = calib_crc16_update(crc, chunk, n);
+      pos += n;
+      left -= n;
+    }
+    return crc == hdr.crc;
+  }
+
+  bool sector_blank(uint8_t sector) {
+    uint8_t chunk[32];
+    for (uint32_t off = 0; off < flash_.sector_size(); off += sizeof(chunk)) {
+      uint32_t n = flash_.sector_size() - off;
+      n = n < sizeof(chunk) ? n : sizeof(chunk);
+      if (!flash_.read(sector, off, chunk, n) || !is_erased(chunk, n))
+        return false;
+    }
+    return true;
+  }
+
+  static bool is_erased(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++)
+      if (p[i] != 0xFF)
+        return false;
+    return true;
+  }
+
+  Backend &flash_;
+  bool mounted_;
+  bool found_;
+  bool spare_erased_; // the spare sector reads blank throughout
+  uint8_t active_;
+  uint32_t free_offset_;
+  CalibRecordHeader newest_;
+  uint32_t newest_offset_;
+  uint32_t seq_;
+  uint32_t erases_;
+};
+
+#endif // CALIB_STORE_H
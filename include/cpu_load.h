@@ -0,0 +1,95 @@
+/**
+ * @file cpu_load.h
+ * @brief CPU utilization over sliding windows (1 s and 10 s)
+ *
+ * Fed every CPU_LOAD_SAMPLE_MS with cumulative counters: uptime, time spent
+ * in the RTOS idle loop and the run time of the instrumented threads. The
+ * last CPU_LOAD_HISTORY samples are kept and a window is the difference
+ * between the newest sample and one N samples older, so a late sample only
+ * widens the window without skewing the shares. Until enough history
+ * exists a window covers what there is.
+ *
+ * busy = 1000 - idle share; "other" is busy time not accounted to an
+ * instrumented thread: the control, log and LED threads and interrupts,
+ * except those that hit an instrumented thread while it was being timed.
+ *
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef CPU_LOAD_H
+#define CPU_LOAD_H
+
+#include <stdint.h>
+
+#ifndef CPU_LOAD_SAMPLE_MS
+#define CPU_LOAD_SAMPLE_MS 1000
+#endif
+#define CPU_LOAD_HISTORY (10000 / CPU_LOAD_SAMPLE_MS + 1) // covers 10 s
+#define CPU_LOAD_THREADS 2 // thread_us[] entries, see main.cpp
+
+struct CpuLoadSample {
+  uint64_t t_us;    // uptime
+  uint64_t idle_us; // in the idle loop, since boot
+  uint64_t thread_us[CPU_LOAD_THREADS];
+};
+
+struct CpuLoadReport {
+  uint32_t window_ms; // 0 until two samples exist
+  uint16_t busy_permille;
+  uint16_t thread_permille[CPU_LOAD_THREADS];
+  uint16_t other_permille;
+};
+
+class CpuLoad {
+public:
+  void add(const CpuLoadSample &s) {
+    hist_[head_] = s;
+    head_ = (uint8_t)((head_ + 1) % CPU_LOAD_HISTORY);
+    if (count_ < CPU_LOAD_HISTORY)
+      count_++;
+  }
+
+  /** Load over the last @p intervals sample intervals. */
+  CpuLoadReport window(uint32_t intervals) const {
+    CpuLoadReport r = {};
+    if (count_ < 2 || intervals == 0)
+      return r;
+    if (intervals > count_ - 1U)
+      intervals = count_ - 1U;
+    const CpuLoadSample &now = at(0);
+    const CpuLoadSample &then = at(intervals);
+    uint64_t dt = now.t_us - then.t_us;
+    if (dt == 0)
+      return r;
+
+    r.window_ms = (uint32_t)(dt / 1000U);
+    r.busy_permille =
+        (uint16_t)(1000U - permille(now.idle_us - then.idle_us, dt));
+    uint32_t threads = 0;
+    for (int i = 0; i < CPU_LOAD_THREADS; i++) {
+      r.thread_permille[i] = permille(now.thread_us[i] - then.thread_us[i], dt);
+      threads += r.thread_permille[i];
+    }
+    r.other_permille =
+        r.busy_permille > threads ? (uint16_t)(r.busy_permille - threads) : 0;
+    return r;
+  }
+
+private:
+  // Sample @p age intervals before the newest.
+  const CpuLoadSample &at(uint32_t age) const {
+    return hist_[(head_ + 2U * CPU_LOAD_HISTORY - 1U - age) %
+                 CPU_LOAD_HISTORY];
+  }
+
+  static uint16_t permille(uint64_t part, uint64_t whole) {
+    uint64_t p = (part * 1000U + whole / 2U) / whole;
+    return (uint16_t)(p > 1000U ? 1000U : p);
+  }
+
+  CpuLoadSample hist_[CPU_LOAD_HISTORY] = {};
+  uint8_t head_ = 0;
+  uint8_t count_ = 0;
+};
+
+#endif // CPU_LOAD_H
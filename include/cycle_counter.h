@@ -0,0 +1,27 @@
+/**
+ * @file cycle_counter.h
+ * @brief Cortex-M4 DWT cycle counter helpers
+ *
+ * CYCCNT runs at the core clock (180 MHz on the F446), is readable from any
+ * context in one load and wraps after ~23.8 s; unsigned subtraction of two
+ * readings is valid across a single wrap.
+ */
+
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include "mbed.h"
+
+static inline void cycle_counter_init() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cycle_counter_now() { return DWT->CYCCNT; }
+
+static inline uint32_t cycles_to_ns(uint32_t cycles) {
+  return (uint32_t)((uint64_t)cycles * 1000U / (SystemCoreClock / 1000000U));
+}
+
+#endif // CYCLE_COUNTER_H
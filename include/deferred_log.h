@@ -0,0 +1,69 @@
+/**
+ * @file deferred_log.h
+ * @brief printf-style logging that never blocks the caller
+ *
+ * log_printf(fmt, args...) stores a compact binary record - the format
+ * string pointer as message id plus up to LOG_MAX_ARGS argument words -
+ * in a lock-free ring and returns. deferred_log_drain(), called from
+ * a low-priority thread, formats the records and writes them to the
+ * console, so the UART time is spent there and not in the caller.
+ *
+ * - Callable from any context, ISRs included. A writer claims a slot with a
+ *   compare-and-swap on the head and stamps it with its sequence number
+ *   once filled; the reader only takes stamped slots in order.
+ * - A full ring drops the new record and counts it; nothing waits.
+ * - The format string and every %s argument must have static storage
+ *   duration (string literals), since only their addresses are stored.
+ * - Arguments are converted by type: floats (and doubles) are stored as
+ *   float, integers as 32 bits, pointers whole (a word is a uintptr_t,
+ *   32 bits on the target). Use %f/%e/%g for floats, %l.. for
+ *   (unsigned) long, as with printf.
+ */
+
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef LOG_RING_LEN
+#define LOG_RING_LEN 64 // records, power of two
+#endif
+#define LOG_MAX_ARGS 8
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX 160 // formatted bytes per record, longer is cut
+#endif
+
+typedef uintptr_t LogWord;
+
+/** Stores one record; see log_printf(). */
+void deferred_log_write(const char *fmt, const LogWord *args, uint8_t nargs);
+
+/**
+ * Formats and prints up to @p max pending records, oldest first. Single
+ * reader. Returns the number printed.
+ */
+uint32_t deferred_log_drain(uint32_t max);
+
+/** Records dropped because the ring was full. */
+uint32_t deferred_log_dropped();
+
+static inline LogWord log_word(float v) {
+  uint32_t w;
+  memcpy(&w, &v, sizeof(w));
+  return w;
+}
+static inline LogWord log_word(double v) { return log_word((float)v); }
+static inline LogWord log_word(const char *s) { return (LogWord)s; }
+template <typename T> static inline LogWord log_word(T v) {
+  return (uint32_t)v;
+}
+
+template <typename... Args>
+static inline void log_printf(const char *fmt, Args... args) {
+  static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+  const LogWord words[sizeof...(Args) + 1] = {log_word(args)..., 0};
+  deferred_log_write(fmt, words, (uint8_t)sizeof...(Args));
+}
+
+#endif // DEFERRED_LOG_H
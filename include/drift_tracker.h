@@ -0,0 +1,119 @@
+/**
+ * @file drift_tracker.h
+ * @brief Slow baseline estimator for the zero-point drift of one sensor
+ *
+ * Over a long print the filament averages out at its nominal diameter, so a
+ * very slow average of the raw signal should sit at the raw value the
+ * calibration maps to that diameter (the reference). What remains is sensor
+ * offset drift (SS495A, temperature).
+ *
+ * Raw samples are averaged in blocks of DRIFT_BLOCK cycles; each block mean
+ * feeds an exponential average with a time constant of 2^DRIFT_SHIFT blocks
+ * (~9 min at 2 ms cycles). Blocks further than DRIFT_GATE_COUNTS from the
+ * current baseline (no filament, a splice, a knot) are ignored. The offset
+ * is reported once DRIFT_MIN_BLOCKS blocks went in, clamped to
+ * +/-DRIFT_MAX_COUNTS.
+ *
+ * The estimator cannot tell sensor drift from filament that really runs
+ * off nominal: a spool that stays e.g. 0.03 mm thick for the ~9 min time
+ * constant is pulled back to nominal just the same. Applied as a
+ * correction it therefore masks a steady real deviation of up to
+ * DRIFT_MAX_COUNTS (~0.047 mm with the default tables). Tracking against a
+ * reference would need a second, filament-free sensor or a temperature
+ * input, which the board does not have; main.cpp keeps the correction off
+ * by default and only reports the estimate.
+ *
+ * Integer only (Q16 baseline), one add per sample on the hot path.
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef DRIFT_TRACKER_H
+#define DRIFT_TRACKER_H
+
+#include <stdint.h>
+
+#ifndef DRIFT_BLOCK
+#define DRIFT_BLOCK 256
+#endif
+#ifndef DRIFT_SHIFT
+#define DRIFT_SHIFT 10
+#endif
+#ifndef DRIFT_GATE_COUNTS
+#define DRIFT_GATE_COUNTS 150
+#endif
+#ifndef DRIFT_MIN_BLOCKS
+#define DRIFT_MIN_BLOCKS (1U << DRIFT_SHIFT)
+#endif
+#ifndef DRIFT_MAX_COUNTS
+#define DRIFT_MAX_COUNTS 100
+#endif
+
+class DriftTracker {
+public:
+  DriftTracker() { set_reference(0); }
+
+  /** New calibration: restart from zero offset around @p raw_nominal. */
+  void set_reference(uint16_t raw_nominal) {
+    reference_ = raw_nominal;
+    baseline_q16_ = (int32_t)raw_nominal << 16;
+    block_sum_ = 0;
+    block_count_ = 0;
+    blocks_ = 0;
+    gated_ = 0;
+    offset_ = 0;
+  }
+
+  void add(uint16_t raw) {
+    block_sum_ += raw;
+    if (++block_count_ < DRIFT_BLOCK)
+      return;
+
+    int32_t mean_q16 = (int32_t)(((uint64_t)block_sum_ << 16) / DRIFT_BLOCK);
+    block_sum_ = 0;
+    block_count_ = 0;
+
+    int32_t diff = mean_q16 - baseline_q16_;
+    if (diff > ((int32_t)DRIFT_GATE_COUNTS << 16) ||
+        diff < -((int32_t)DRIFT_GATE_COUNTS << 16)) {
+      gated_++;
+      return;
+    }
+    baseline_q16_ += diff / (1 << DRIFT_SHIFT);
+    if (blocks_ < DRIFT_MIN_BLOCKS)
+      blocks_++;
+
+    if (blocks_ >= DRIFT_MIN_BLOCKS) {
+      int32_t off_q16 = baseline_q16_ - ((int32_t)reference_ << 16);
+      int32_t off = (off_q16 + 0x8000) >> 16;
+      if (off > DRIFT_MAX_COUNTS)
+        off = DRIFT_MAX_COUNTS;
+      if (off < -DRIFT_MAX_COUNTS)
+        off = -DRIFT_MAX_COUNTS;
+      offset_ = (int16_t)off;
+    }
+  }
+
+  /** Estimated offset in raw counts (raw - offset is the corrected value). */
+  int16_t offset() const { return offset_; }
+
+  /** Applies the offset, saturated to the 12-bit ADC range. */
+  uint16_t correct(uint16_t raw) const {
+    int32_t v = (int32_t)raw - offset_;
+    return (uint16_t)(v < 0 ? 0 : v > 4095 ? 4095 : v);
+  }
+
+  bool settled() const { return blocks_ >= DRIFT_MIN_BLOCKS; }
+  uint16_t reference() const { return reference_; }
+  uint32_t gated_blocks() const { return gated_; }
+
+private:
+  uint16_t reference_;
+  int32_t baseline_q16_; // slow average of the raw signal, Q16
+  uint32_t block_sum_;
+  uint16_t block_count_;
+  uint32_t blocks_; // accepted blocks, saturates at DRIFT_MIN_BLOCKS
+  uint32_t gated_;  // blocks ignored by the gate
+  volatile int16_t offset_;
+};
+
+#endif // DRIFT_TRACKER_H
@@ -0,0 +1,326 @@
+/**
+ * @file ext_frame.h
+ * @brief Wire format of the extended I2C stream (secondary slave address)
+ *
+ * The primary address keeps serving the legacy 10-byte digit frame. The
+ * secondary address serves little-endian binary pages:
+ *
+ * - Writing one byte selects the page returned by subsequent reads. The
+ *   selection is sticky, so tooling selects once and then just reads.
+ * - Page EXT_PAGE_STREAM (default) carries the newest EXT_FIFO_DEPTH
+ *   acquisition samples with timestamps and sequence numbers; a host reading
+ *   at least every EXT_FIFO_DEPTH cycles sees every sample exactly once
+ *   after de-duplicating by sequence number.
+ * - Page EXT_PAGE_DIAG carries link and firmware diagnostics.
+ * - Page EXT_PAGE_TIMING carries acquisition period statistics, a jitter
+ *   histogram and the cycle counts of the pipeline stages.
+ * - Page EXT_PAGE_CALIB carries the active calibration tables and the state
+ *   of the calibration commands below.
+ * - Page EXT_PAGE_FIT carries the least-squares fit points of one sensor
+ *   with their residuals and the quality of the last fit.
+ *
+ * Writes whose first byte is >= 0x80 are commands instead of page selects
+ * (multi-byte fields little-endian, diameters in mm x 10000):
+ * - EXT_CMD_CAL_WRITE  sensor, then EXT_CAL_POINTS x {raw u16, mm u16}:
+ *   replaces the table of one sensor; raw values must strictly increase.
+ * - EXT_CMD_CAL_CAPTURE  sensor, point, mm u16: waits for the live raw value
+ *   of that sensor to settle, averages it with outlier rejection and stores
+ *   it as the given point at diameter mm.
+ * - EXT_CMD_CAL_PROFILE  profile, then an optional name (up to
+ *   EXT_CAL_PROFILE_NAME_LEN - 1 bytes): makes that calibration profile
+ *   active, renaming it if a name is given. An unused profile starts as a
+ *   copy of the active tables; the commands above then edit it.
+ * - EXT_CMD_CAL_FIT_ADD  sensor, raw u16, mm u16: adds a point to the fit
+ *   set of that sensor; raw EXT_CAL_RAW_CAPTURE captures the live value
+ *   like EXT_CMD_CAL_CAPTURE instead.
+ * - EXT_CMD_CAL_FIT_SOLVE  sensor, degree (1 or 2), apply: fits a
+ *   polynomial to the set and reports it on the fit page; with apply set
+ *   and a successful fit it replaces the table of that sensor in the
+ *   conversion until that table changes again.
+ * - EXT_CMD_CAL_FIT_CLEAR  sensor: empties the fit set.
+ * Accepted tables become active between two acquisition cycles and are
+ * persisted; the calibration page reports the outcome.
+ *
+ * The first byte of every page ("lead") is undefined on the wire: the slave
+ * pre-stages byte 0 of the legacy frame in the data register so reads never
+ * stretch SCL, and that byte leads reads on this address too.
+ *
+ * Every page ends with a CRC-16/CCITT-FALSE over all bytes after the lead
+ * byte and before the CRC.
+ * Shared between firmware and host tools; keep it free of mbed includes.
+ */
+
+#ifndef EXT_FRAME_H
+#define EXT_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EXT_FRAME_MAGIC 0xA5
+/* One version for the header and all pages. Bumped on every change to a
+ * layout or to the meaning of a field or bit, and never reused, so a host
+ * decoder can reject layouts it does not know. */
+#define EXT_FRAME_VERSION 16
+
+#define EXT_PAGE_STREAM 0x00
+#define EXT_PAGE_DIAG 0x01
+#define EXT_PAGE_TIMING 0x02
+#define EXT_PAGE_CALIB 0x03
+#define EXT_PAGE_FIT 0x04
+#define EXT_PAGE_COUNT 5
+
+#define EXT_CMD_CAL_WRITE 0x80
+#define EXT_CMD_CAL_CAPTURE 0x81
+#define EXT_CMD_CAL_PROFILE 0x82
+#define EXT_CMD_CAL_FIT_ADD 0x83
+#define EXT_CMD_CAL_FIT_SOLVE 0x84
+#define EXT_CMD_CAL_FIT_CLEAR 0x85
+
+#define EXT_CAL_RAW_CAPTURE 0xFFFF // EXT_CMD_CAL_FIT_ADD: capture live raw
+
+/* ExtCalibPage::last_result */
+#define EXT_CAL_OK 0
+#define EXT_CAL_PENDING 1  // capture still running
+#define EXT_CAL_BUSY 2     // another calibration is in progress
+#define EXT_CAL_BAD_ARGS 3 // rejected, tables unchanged
+#define EXT_CAL_UNSTABLE 4 // capture never settled, tables unchanged
+#define EXT_CAL_FIT_FAILED 5 // see ExtFitPage::status, tables unchanged
+
+/* ExtCalibPage::cal_state */
+#define EXT_CAL_STATE_IDLE 0
+#define EXT_CAL_STATE_WAIT_NEXT 1 // button session waiting for NEXT
+#define EXT_CAL_STATE_CAPTURE 2
+
+#define EXT_CAL_SENSORS 2
+#define EXT_CAL_POINTS 3
+#define EXT_CAL_PROFILES 4
+#define EXT_CAL_PROFILE_NAME_LEN 12 // including the terminating NUL
+#define EXT_FIT_MAX_POINTS 16
+
+/* ExtFitPage::status */
+#define EXT_FIT_OK 0
+#define EXT_FIT_TOO_FEW 1       // needs degree + 2 points
+#define EXT_FIT_SINGULAR 2      // raw values not distinct enough
+#define EXT_FIT_NOT_MONOTONIC 3 // curve turns within the data
+#define EXT_FIT_BAD_DEGREE 4
+#define EXT_FIT_NONE 0xFF // no fit since the set last changed
+
+#ifndef EXT_FIFO_DEPTH
+#define EXT_FIFO_DEPTH 16
+#endif
+
+/* Index into ExtDiagPage::stack_used / stack_size */
+#define EXT_THREAD_MAIN 0
+#define EXT_THREAD_ACQ 1
+#define EXT_THREAD_I2C 2
+#define EXT_THREAD_LED 3
+#define EXT_THREAD_LOG 4
+#define EXT_THREAD_COUNT 5
+
+/* Index into ExtCpuLoad::thread_permille */
+#define EXT_LOAD_ACQ 0
+#define EXT_LOAD_I2C 1
+#define EXT_LOAD_THREADS 2
+
+/* ExtDiagPage::drift_flags */
+#define EXT_DRIFT_ENABLED (1U << 0)    // correction applied to the output
+#define EXT_DRIFT_SETTLED_S1 (1U << 1) // estimator has enough history
+#define EXT_DRIFT_SETTLED_S2 (1U << 2)
+
+/* Jitter histogram bins on the timing page */
+#define EXT_HIST_BINS 16
+
+/* ExtTimingPage::stages, see stage_profile.h */
+#define EXT_STAGE_READ 0
+#define EXT_STAGE_CONVERT 1
+#define EXT_STAGE_FORMAT 2
+#define EXT_STAGE_PUBLISH 3
+#define EXT_STAGE_EXT_PAGE 4
+#define EXT_STAGE_COUNT 5
+
+/* ExtFrameHeader::status bits */
+#define EXT_STATUS_TEST_MODE (1U << 0)
+#define EXT_STATUS_CALIBRATING (1U << 1)
+#define EXT_STATUS_I2C_RECOVERING (1U << 2)
+#define EXT_STATUS_FLASH_BUSY (1U << 3) // erase next/running, reads stall
+
+struct __attribute__((packed)) ExtFrameHeader {
+  uint8_t lead;    // don't-care, see above
+  uint8_t magic;   // EXT_FRAME_MAGIC
+  uint8_t version; // EXT_FRAME_VERSION
+  uint8_t page;    // EXT_PAGE_*
+  uint16_t length; // total page length in bytes, including lead and CRC
+};
+
+struct __attribute__((packed)) ExtSample {
+  uint32_t seq;          // acquisition cycle number
+  uint32_t t_us;         // cycle timestamp (uptime, wraps after ~71 min)
+  uint16_t raw[2];       // burst-averaged 12-bit ADC values
+  uint16_t mm_x10000[2]; // converted diameters, saturated at 6.5535 mm
+};
+
+struct __attribute__((packed)) ExtStreamPage {
+  ExtFrameHeader hdr;
+  uint16_t status; // EXT_STATUS_* bits
+  uint8_t count;   // valid entries in samples[], oldest first
+  uint8_t reserved;
+  ExtSample samples[EXT_FIFO_DEPTH];
+  uint16_t crc;
+};
+
+struct __attribute__((packed)) ExtCpuLoad {
+  uint16_t window_ms;     // time covered, 0 before the first full sample
+  uint16_t busy_permille; // not in the RTOS idle loop
+  uint16_t thread_permille[EXT_LOAD_THREADS]; // EXT_LOAD_* order
+  uint16_t other_permille; // busy outside the listed threads
+};
+
+struct __attribute__((packed)) ExtDiagPage {
+  ExtFrameHeader hdr;
+  uint32_t uptime_ms;
+  uint32_t acq_cycles;
+  uint32_t frames_published;
+  uint32_t i2c_reads;
+  uint32_t i2c_writes;
+  uint32_t i2c_partial_reads;
+  uint32_t i2c_bus_errors;
+  uint32_t i2c_arb_lost;
+  uint32_t i2c_overruns;
+  uint32_t i2c_timeouts;
+  uint32_t i2c_sda_stuck;
+  uint32_t i2c_scl_stuck;
+  uint32_t i2c_recoveries;
+  uint32_t i2c_staged_reads;
+  uint32_t i2c_unstaged_reads; // byte 0 not pre-staged (NOSTRETCH: at risk)
+  uint32_t i2c_tx_underruns;
+  uint32_t i2c_stretch_ns_min; // 0 under NOSTRETCH, see I2CSlaveStats
+  uint32_t i2c_stretch_ns_max;
+  uint32_t i2c_stretch_ns_mean;
+  uint32_t acq_latency_ns_min; // acquisition tick -> frame published
+  uint32_t acq_latency_ns_max;
+  uint32_t acq_latency_ns_mean;
+  uint32_t acq_ticks_missed; // ticks dropped while a cycle was still queued
+  // Sleep/wake accounting. Wake sources are the acquisition ticks
+  // (acq_cycles) and I2C interrupts (i2c_irqs).
+  uint32_t i2c_irqs;
+  uint32_t cpu_idle_ms;           // time spent in the RTOS idle thread
+  uint32_t cpu_sleep_ms;          // of which in sleep mode (WFI)
+  uint32_t cpu_deep_sleep_ms;     // of which in STOP mode (locked out by I2C)
+  uint32_t acq_busy_ms;           // acquisition thread run time
+  uint32_t i2c_busy_ms;           // I2C service thread run time
+  uint32_t acq_period_dev_ns_max; // worst |cycle period - ACQ_PERIOD_US|
+  // Watchdog supervisor: why this boot started and how the previous one
+  // ended (see include/supervisor.h).
+  uint8_t reset_reason;     // SUPERVISOR_RESET_*
+  uint8_t prev_missed_mask; // channels that missed their check-in
+  uint16_t boot_count;
+  uint32_t prev_uptime_ms;
+  uint16_t stack_used[EXT_THREAD_COUNT]; // peak bytes, EXT_THREAD_* order
+  uint16_t stack_size[EXT_THREAD_COUNT];
+  int16_t drift_offset[2]; // estimated zero-point drift, raw counts
+  uint8_t drift_flags;     // EXT_DRIFT_*
+  uint8_t reserved;
+  uint32_t log_dropped; // console records lost to a full log ring
+  ExtCpuLoad load_1s;   // CPU utilization over the last second
+  ExtCpuLoad load_10s;  // and the last ten seconds
+  char fw_version[8];
+  uint16_t crc;
+};
+
+struct __attribute__((packed)) ExtStageStats {
+  uint32_t count; // timed calls since boot
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint32_t mean_cycles;
+};
+
+struct __attribute__((packed)) ExtTimingPage {
+  ExtFrameHeader hdr;
+  uint32_t nominal_ns; // configured acquisition period
+  uint32_t count;      // periods measured since boot
+  uint32_t min_ns;
+  uint32_t max_ns;
+  uint32_t mean_ns;
+  uint32_t dev_ns_max;    // worst |period - nominal|
+  int32_t hist_lower_ns;  // lower edge of hist[0] relative to nominal
+  uint32_t hist_bin_ns;   // width of each bin; outer bins are open-ended
+  uint32_t hist[EXT_HIST_BINS];
+  uint32_t core_hz; // CYCCNT rate
+  ExtStageStats stages[EXT_STAGE_COUNT];
+  uint16_t crc;
+};
+
+static inline uint16_t ext_crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                           : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+/** CRC as stored in a page: skips the lead byte and the CRC itself. */
+static inline uint16_t ext_page_crc(const uint8_t *page, size_t len) {
+  return ext_crc16(page + 1, len - 1 - sizeof(uint16_t));
+}
+
+/** Fills in the header and trailing CRC of a page struct in place. */
+template <typename Page> static inline void ext_seal(Page *p, uint8_t page) {
+  p->hdr.lead = 0;
+  p->hdr.magic = EXT_FRAME_MAGIC;
+  p->hdr.version = EXT_FRAME_VERSION;
+  p->hdr.page = page;
+  p->hdr.length = (uint16_t)sizeof(Page);
+  p->crc = ext_page_crc((const uint8_t *)p, sizeof(Page));
+}
+
+struct __attribute__((packed)) ExtCalPoint {
+  uint16_t raw;          // 12-bit ADC value
+  uint16_t mm_x10000;    // reference diameter
+  uint16_t raw_var_x100; // capture variance in counts^2 x 100, saturated
+};
+
+struct __attribute__((packed)) ExtCalibPage {
+  ExtFrameHeader hdr;
+  uint8_t cal_state;   // EXT_CAL_STATE_*
+  uint8_t last_cmd;    // EXT_CMD_* of the last command, 0 if none
+  uint8_t last_result; // EXT_CAL_*
+  uint8_t profile;     // active calibration profile
+  uint32_t cmd_count; // commands received
+  uint32_t store_seq; // sequence number of the newest stored record
+  // Last point capture: samples until stable, then used / rejected samples.
+  uint32_t capture_settle;
+  uint32_t capture_accepted;
+  uint32_t capture_rejected;
+  ExtCalPoint points[EXT_CAL_SENSORS][EXT_CAL_POINTS];
+  uint8_t profile_used; // bit per profile holding tables
+  char profile_name[EXT_CAL_PROFILE_NAME_LEN];
+  uint8_t fit_degree[EXT_CAL_SENSORS]; // fitted curve in use, 0: tables
+  uint16_t crc;
+};
+
+struct __attribute__((packed)) ExtFitPoint {
+  uint16_t raw;
+  uint16_t mm_x10000;      // reference diameter
+  int16_t residual_x10000; // measured - fitted mm, saturated; 0 if no fit
+};
+
+// Floats are IEEE-754 single precision, little-endian.
+struct __attribute__((packed)) ExtFitPage {
+  ExtFrameHeader hdr;
+  uint8_t sensor; // sensor whose set is listed
+  uint8_t count;  // valid entries in points[]
+  uint8_t status; // EXT_FIT_* of the last fit of that set
+  uint8_t degree;
+  float center;   // mm = c0 + c1 * d + c2 * d^2, d = raw - center
+  float coeff[3];
+  uint32_t rms_nm;
+  uint32_t max_abs_nm; // largest residual
+  uint32_t r2_ppm;     // R^2 x 1e6
+  ExtFitPoint points[EXT_FIT_MAX_POINTS];
+  uint16_t crc;
+};
+
+#endif // EXT_FRAME_H
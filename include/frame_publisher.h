@@ -0,0 +1,86 @@
+/**
+ * @file frame_publisher.h
+ * @brief Lock-free triple buffer for publishing fixed-size I2C frames
+ *
+ * One writer (acquisition) and one reader (I2C address-match ISR) exchange
+ * frames without disabling interrupts:
+ * - the writer fills its private slot, then swaps it with the shared
+ *   "ready" slot in a single atomic exchange;
+ * - the reader, when a newer frame is ready, swaps its private slot with the
+ *   ready slot the same way.
+ *
+ * The slot the reader holds stays untouched until its next acquire(), so a
+ * DMA transfer started from it always sends one coherent frame. The writer
+ * never waits, no matter how long a read takes.
+ *
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef FRAME_PUBLISHER_H
+#define FRAME_PUBLISHER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t N> class FramePublisher {
+public:
+  static const size_t kFrameLen = N;
+
+  FramePublisher() : write_idx_(0), read_idx_(2), ready_(1), published_(0) {
+    memset(slots_, 0, sizeof(slots_));
+  }
+
+  // --------------------------------------------------------------------------
+  // Writer side (single thread)
+  // --------------------------------------------------------------------------
+
+  /** Private slot of the writer; fill it, then call publish(). */
+  uint8_t *write_buffer() { return slots_[write_idx_]; }
+
+  /** Makes the write buffer the newest frame and takes a fresh one. */
+  void publish() {
+    uint8_t prev =
+        ready_.exchange(write_idx_ | kDirty, std::memory_order_acq_rel);
+    write_idx_ = prev & kIndexMask;
+    published_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void publish(const uint8_t *frame) {
+    memcpy(write_buffer(), frame, N);
+    publish();
+  }
+
+  uint32_t published_count() const {
+    return published_.load(std::memory_order_relaxed);
+  }
+
+  // --------------------------------------------------------------------------
+  // Reader side (single context, e.g. one ISR)
+  // --------------------------------------------------------------------------
+
+  /**
+   * Returns the newest complete frame. The pointer stays valid and unchanged
+   * until the next acquire() from the same reader.
+   */
+  const uint8_t *acquire() {
+    if (ready_.load(std::memory_order_relaxed) & kDirty) {
+      uint8_t prev = ready_.exchange(read_idx_, std::memory_order_acq_rel);
+      read_idx_ = prev & kIndexMask;
+    }
+    return slots_[read_idx_];
+  }
+
+private:
+  static const uint8_t kIndexMask = 0x03;
+  static const uint8_t kDirty = 0x80;
+
+  uint8_t slots_[3][N];
+  uint8_t write_idx_;          // owned by the writer
+  uint8_t read_idx_;           // owned by the reader
+  std::atomic<uint8_t> ready_; // shared slot index + dirty flag
+  std::atomic<uint32_t> published_;
+};
+
+#endif // FRAME_PUBLISHER_H
@@ -0,0 +1,160 @@
+/**
+ * @file i2c_slave_dma.h
+ * @brief Interrupt-driven I2C1 slave with DMA-fed transmit (STM32F446)
+ *
+ * Replaces the polled mbed I2CSlave path. Address match runs in the I2C1
+ * event ISR, which asks the frame source for the buffer to serve and points
+ * DMA1 Stream 7 / Channel 1 (I2C1_TX) at it. The CPU then only sees the
+ * address-match, NACK and STOP interrupts of a read, independent of the
+ * frame length.
+ *
+ * Stream 7 is used (not Stream 6) so that USART2_TX keeps its only DMA
+ * mapping, which the console needs (serial_port.h).
+ *
+ * An optional second own address (OAR2, dual addressing) is supported;
+ * SR2.DUALF tells the callbacks which address a transfer belongs to.
+ *
+ * The first byte of every read is pre-staged in DR while the bus is idle
+ * (i2c_slave_dma_restage() after each publish), taken from the primary
+ * frame source. With I2C_SLAVE_NOSTRETCH=1 the peripheral then answers the
+ * address match without any clock stretching and DMA only has to supply
+ * byte 1 onwards within one byte time. A read on the secondary address
+ * therefore starts with that staged byte, so secondary frames must treat
+ * their first byte as don't-care.
+ *
+ * While initialized the driver holds a deep-sleep lock: the F4 I2C cannot
+ * wake the core from STOP mode on address match, only from sleep (WFI).
+ *
+ * Bus failures are handled by a non-blocking recovery state machine stepped
+ * from the service thread via i2c_slave_dma_service(): it detects transfer
+ * timeouts and stuck SDA/SCL lines, releases the bus (peripheral reset,
+ * SCL clock-out + STOP), reinitializes the slave and backs off
+ * exponentially while the bus stays held.
+ */
+
+#ifndef I2C_SLAVE_DMA_H
+#define I2C_SLAVE_DMA_H
+
+#include <stdint.h>
+
+/* Event flags delivered to the service thread via i2c_slave_dma_wait(). */
+#define I2C_SLAVE_EVT_ERROR (1UL << 0)
+
+/* Address index passed to the callbacks. */
+#define I2C_SLAVE_ADDR_PRIMARY 0
+#define I2C_SLAVE_ADDR_SECONDARY 1
+
+/* Bytes kept from one host write; the rest is drained and counted. */
+#ifndef I2C_SLAVE_RX_MAX
+#define I2C_SLAVE_RX_MAX 32
+#endif
+
+/* Disable clock stretching (CR1.NOSTRETCH); relies on the staged byte. */
+#ifndef I2C_SLAVE_NOSTRETCH
+#define I2C_SLAVE_NOSTRETCH 1
+#endif
+
+/* Byte clocked out when the master reads past the end of the frame. */
+#define I2C_SLAVE_TX_PAD_BYTE 0xFF
+
+/* Recovery tuning; all values in milliseconds. */
+#ifndef I2C_SLAVE_SERVICE_PERIOD_MS
+#define I2C_SLAVE_SERVICE_PERIOD_MS 20
+#endif
+#ifndef I2C_SLAVE_XFER_TIMEOUT_MS
+#define I2C_SLAVE_XFER_TIMEOUT_MS 50
+#endif
+/* A line counts as stuck after reading low continuously for this long. */
+#ifndef I2C_SLAVE_STUCK_LINE_MS
+#define I2C_SLAVE_STUCK_LINE_MS 10
+#endif
+#ifndef I2C_SLAVE_BACKOFF_MIN_MS
+#define I2C_SLAVE_BACKOFF_MIN_MS 2
+#endif
+#ifndef I2C_SLAVE_BACKOFF_MAX_MS
+#define I2C_SLAVE_BACKOFF_MAX_MS 500
+#endif
+
+/**
+ * Called from ISR context on every ReadAddressed. Returns the buffer to
+ * transmit and stores its length in *len. The buffer must stay untouched
+ * until the next call for the same address, which is never earlier than the
+ * end of the transfer.
+ */
+typedef const uint8_t *(*i2c_slave_frame_source_t)(uint8_t addr_index,
+                                                   uint16_t *len);
+
+/**
+ * Called from ISR context when a host write ends (STOP or repeated START)
+ * with the bytes received, truncated to I2C_SLAVE_RX_MAX. May be null.
+ */
+typedef void (*i2c_slave_write_sink_t)(uint8_t addr_index,
+                                       const uint8_t *data, uint16_t len);
+
+struct I2CSlaveStats {
+  uint32_t irqs;            // event + error interrupts taken (wakeups)
+  uint32_t reads;           // ReadAddressed transfers started
+  uint32_t writes;          // WriteAddressed transfers started
+  uint32_t tx_pad_bytes;    // bytes padded after the frame was exhausted
+  uint32_t partial_reads;   // reads NACKed before the frame was complete
+  uint32_t secondary_reads; // reads on the OAR2 address (subset of reads)
+  uint32_t rx_dropped;      // write bytes beyond I2C_SLAVE_RX_MAX
+  uint32_t staged_reads;    // reads answered from the pre-staged DR byte
+  uint32_t unstaged_reads;  // byte 0 written by the ADDR handler instead
+  uint32_t tx_underruns;    // NOSTRETCH: DMA missed a byte slot (OVR in TX)
+  // SCL stretch per read, measured from ADDR ISR entry (interrupt latency
+  // not included) until the first byte is available to the shifter. Only
+  // with clock stretching; under NOSTRETCH nothing stretches and these stay
+  // 0: there an unstaged read or an underrun is what costs a byte.
+  uint32_t stretch_ns_min;
+  uint32_t stretch_ns_max;
+  uint32_t stretch_ns_mean;
+  // Failure classes, one counter each
+  uint32_t bus_errors; // BERR
+  uint32_t arb_lost;   // ARLO
+  uint32_t overruns;   // OVR
+  uint32_t timeouts;   // addressed transfer did not finish in time
+  uint32_t sda_stuck;  // SDA held low while the bus should be idle
+  uint32_t scl_stuck;  // SCL held low while the bus should be idle
+  // Recovery actions
+  uint32_t bus_clears;      // SCL clock-out sequences issued
+  uint32_t recoveries;      // slave reinitialized after a failure
+  uint32_t recovery_ms_max; // longest failure-to-reinit time
+};
+
+/**
+ * (Re)initializes I2C1 as slave at @p address8 and, if non-zero,
+ * @p address2_8 (both 8-bit form). Safe to call again for recovery; resets
+ * any transfer in progress.
+ */
+void i2c_slave_dma_init(uint8_t address8, uint8_t address2_8, uint32_t bus_hz,
+                        i2c_slave_frame_source_t source,
+                        i2c_slave_write_sink_t sink);
+void i2c_slave_dma_deinit();
+
+/**
+ * Requests that the first byte of the newest primary frame be loaded into
+ * DR. Call after publishing; the staging itself runs in the I2C ISR.
+ */
+void i2c_slave_dma_restage();
+
+/**
+ * Blocks the calling thread until one of @p flags is raised by the ISR or
+ * @p timeout_ms elapses.
+ */
+uint32_t i2c_slave_dma_wait_for(uint32_t flags, uint32_t timeout_ms);
+
+/**
+ * Runs one step of fault detection / bus recovery. Never blocks for more
+ * than one SCL clock-out (~100 us). Returns the delay in ms until the next
+ * step should run; call it again earlier if I2C_SLAVE_EVT_ERROR is raised.
+ */
+uint32_t i2c_slave_dma_service();
+
+/** True while the recovery state machine has the slave offline. */
+bool i2c_slave_dma_recovering();
+
+/** Copies the counters; callable from any thread. */
+void i2c_slave_dma_get_stats(I2CSlaveStats *out);
+
+#endif // I2C_SLAVE_DMA_H
@@ -0,0 +1,78 @@
+/**
+ * @file i2c_trace.h
+ * @brief I2C slave event trace for the debug build (I2C_DEBUG_ENABLE)
+ *
+ * The slave driver records its transfer and recovery events into a ring of
+ * I2C_DEBUG_EVENT_QUEUE_LEN entries; a low-priority thread drains it and
+ * prints the events every I2C_DEBUG_PRINT_PERIOD_MS (see main.cpp).
+ *
+ * Recording is lock-free and callable from any context: a writer claims a
+ * slot with one atomic increment of the head, fills it and stamps it with
+ * its sequence number last. The ring overwrites the oldest entries; the
+ * reader uses the stamps to skip entries that were overwritten or are still
+ * being written and counts the lost ones. A record costs a CYCCNT read, the
+ * atomic increment and four stores.
+ *
+ * With I2C_DEBUG_ENABLE=0 (default) I2C_TRACE() compiles to nothing.
+ */
+
+#ifndef I2C_TRACE_H
+#define I2C_TRACE_H
+
+#include <stdint.h>
+
+#ifndef I2C_DEBUG_ENABLE
+#define I2C_DEBUG_ENABLE 0
+#endif
+#ifndef I2C_DEBUG_PRINT_PERIOD_MS
+#define I2C_DEBUG_PRINT_PERIOD_MS 1000
+#endif
+#ifndef I2C_DEBUG_EVENT_QUEUE_LEN
+#define I2C_DEBUG_EVENT_QUEUE_LEN 64 // power of two
+#endif
+
+/* I2CTraceEvent::type; a and b as noted */
+#define I2C_TRACE_ADDR_READ 1  // a: address index | I2C_TRACE_STAGED, b: len
+#define I2C_TRACE_ADDR_WRITE 2 // a: address index
+#define I2C_TRACE_READ_END 3   // NACK; a: 1 if a byte was left in DR
+#define I2C_TRACE_WRITE_END 4  // a: first byte (page / command), b: length
+#define I2C_TRACE_PAD 5        // master read past the frame
+#define I2C_TRACE_UNDERRUN 6   // NOSTRETCH transmit underrun
+#define I2C_TRACE_ERROR 7      // b: SR1 error bits (BERR/ARLO/OVR)
+#define I2C_TRACE_FAILURE 8    // service step; b: failure class bits
+#define I2C_TRACE_BUS_CLEAR 9  // SCL clock-out issued
+#define I2C_TRACE_BACKOFF 10   // b: delay in ms
+#define I2C_TRACE_REINIT 11    // a: 1 after recovery, b: recovery ms
+
+#define I2C_TRACE_STAGED 0x80
+
+struct I2CTraceEvent {
+  uint32_t seq;    // ring position + 1 once complete, 0 while unwritten
+  uint32_t cycles; // CYCCNT at the event
+  uint8_t type;    // I2C_TRACE_*
+  uint8_t a;
+  uint16_t b;
+};
+
+#if I2C_DEBUG_ENABLE
+
+void i2c_trace_record(uint8_t type, uint8_t a, uint16_t b);
+
+/**
+ * Copies up to @p max events, oldest first, into @p out. Single reader.
+ * Adds the number of events overwritten before they were read to *lost.
+ */
+uint32_t i2c_trace_drain(I2CTraceEvent *out, uint32_t max, uint32_t *lost);
+
+/** Short event name for printing. */
+const char *i2c_trace_name(uint8_t type);
+
+#define I2C_TRACE(type, a, b) i2c_trace_record((type), (a), (b))
+
+#else
+
+#define I2C_TRACE(type, a, b) ((void)0)
+
+#endif // I2C_DEBUG_ENABLE
+
+#endif // I2C_TRACE_H
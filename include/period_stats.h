@@ -0,0 +1,100 @@
+/**
+ * @file period_stats.h
+ * @brief Min/max/mean and jitter histogram of a nominally fixed period
+ *
+ * Fed with one measured period per cycle. The histogram bins the deviation
+ * from the nominal period: PERIOD_HIST_BINS bins of PERIOD_HIST_BIN_NS each,
+ * centred on zero, with the outermost bins also collecting everything beyond
+ * them.
+ *
+ * Not synchronized; the owner serializes add() against snapshot().
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef PERIOD_STATS_H
+#define PERIOD_STATS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef PERIOD_HIST_BINS
+#define PERIOD_HIST_BINS 16
+#endif
+#ifndef PERIOD_HIST_BIN_NS
+#define PERIOD_HIST_BIN_NS 1000
+#endif
+
+struct PeriodSnapshot {
+  uint32_t count; // periods recorded
+  uint32_t min_ns;
+  uint32_t max_ns;
+  uint32_t mean_ns;
+  uint32_t dev_ns_max; // worst |period - nominal|
+  uint32_t hist[PERIOD_HIST_BINS];
+};
+
+class PeriodStats {
+public:
+  explicit PeriodStats(uint32_t nominal_ns) : nominal_ns_(nominal_ns) {
+    reset();
+  }
+
+  void reset() {
+    count_ = 0;
+    min_ns_ = 0;
+    max_ns_ = 0;
+    sum_ns_ = 0;
+    memset(hist_, 0, sizeof(hist_));
+  }
+
+  void add(uint32_t period_ns) {
+    if (count_ == 0 || period_ns < min_ns_)
+      min_ns_ = period_ns;
+    if (period_ns > max_ns_)
+      max_ns_ = period_ns;
+    sum_ns_ += period_ns;
+    count_++;
+    hist_[bin_of(period_ns)]++;
+  }
+
+  void snapshot(PeriodSnapshot *out) const {
+    out->count = count_;
+    out->min_ns = min_ns_;
+    out->max_ns = max_ns_;
+    out->mean_ns = count_ ? (uint32_t)(sum_ns_ / count_) : 0;
+    uint32_t below = (count_ && min_ns_ < nominal_ns_) ? nominal_ns_ - min_ns_
+                                                       : 0;
+    uint32_t above = (max_ns_ > nominal_ns_) ? max_ns_ - nominal_ns_ : 0;
+    out->dev_ns_max = below > above ? below : above;
+    memcpy(out->hist, hist_, sizeof(hist_));
+  }
+
+  uint32_t nominal_ns() const { return nominal_ns_; }
+
+  /** Lower edge of bin @p i as deviation from nominal, in ns. */
+  static int32_t bin_lower_ns(uint8_t i) {
+    return ((int32_t)i - PERIOD_HIST_BINS / 2) * PERIOD_HIST_BIN_NS;
+  }
+
+private:
+  uint8_t bin_of(uint32_t period_ns) const {
+    int64_t dev = (int64_t)period_ns - (int64_t)nominal_ns_;
+    int64_t bin = dev / PERIOD_HIST_BIN_NS + PERIOD_HIST_BINS / 2;
+    if (dev < 0 && dev % PERIOD_HIST_BIN_NS != 0)
+      bin--; // floor towards the earlier bin
+    if (bin < 0)
+      return 0;
+    if (bin >= PERIOD_HIST_BINS)
+      return PERIOD_HIST_BINS - 1;
+    return (uint8_t)bin;
+  }
+
+  uint32_t nominal_ns_;
+  uint32_t count_;
+  uint32_t min_ns_;
+  uint32_t max_ns_;
+  uint64_t sum_ns_;
+  uint32_t hist_[PERIOD_HIST_BINS];
+};
+
+#endif // PERIOD_STATS_H
@@ -0,0 +1,80 @@
+/**
+ * @file serial_port.h
+ * @brief USART2 (ST-LINK virtual COM port) with DMA transmit, as console
+ *
+ * Replaces mbed's console serial: mbed_override_console() returns this
+ * driver, so printf and the deferred log go through it. Written bytes are
+ * copied into a TX ring of SERIAL_TX_RING_SIZE and sent by DMA1 Stream 6 /
+ * Channel 4 (USART2_TX) in contiguous chunks, each restarted from the
+ * transfer-complete interrupt. The CPU cost per byte is the copy, which
+ * keeps baud rates in the Mbaud range affordable.
+ *
+ * serial_port_write() never waits and is callable from threads and ISRs.
+ * Console writes from threads wait for ring space the way a blocking
+ * serial would; with interrupts disabled (fatal error output) they fall
+ * back to polling the UART.
+ *
+ * A console sink (serial_port_set_console_sink) takes the console text
+ * instead, e.g. to wrap it into packets while a binary stream runs.
+ *
+ * Received bytes are collected by the USART2 interrupt in a ring of
+ * SERIAL_RX_RING_SIZE and taken with serial_port_read(); overruns and a
+ * full ring are counted, not waited for.
+ *
+ * The driver holds a deep-sleep lock while a transfer runs: USART and DMA
+ * stop in STOP mode. Reception has no lock of its own; the I2C slave keeps
+ * the core out of STOP mode for as long as it runs.
+ */
+
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SERIAL_TX_RING_SIZE
+#define SERIAL_TX_RING_SIZE 4096 // power of two
+#endif
+#ifndef SERIAL_CONSOLE_BAUD
+#define SERIAL_CONSOLE_BAUD MBED_CONF_PLATFORM_STDIO_BAUD_RATE
+#endif
+#ifndef SERIAL_RX_RING_SIZE
+#define SERIAL_RX_RING_SIZE 256 // power of two
+#endif
+/* Bytes copied per critical section; longer writes are cut there. */
+#define SERIAL_WRITE_CHUNK 128
+
+/** Receives console text while installed; must not block. */
+typedef void (*serial_console_sink_t)(const void *data, size_t len);
+
+/** Sets up USART2, its TX DMA and RX interrupt. Done by the console. */
+void serial_port_init(uint32_t baud);
+
+/**
+ * Waits until everything queued has been sent, then switches the baud rate.
+ * Thread context. Returns the rate actually set (PCLK1 / integer divider).
+ */
+uint32_t serial_port_set_baud(uint32_t baud);
+
+uint32_t serial_port_baud();
+
+/**
+ * Queues up to min(len, SERIAL_WRITE_CHUNK) bytes without waiting. With
+ * @p all set either that many bytes fit or nothing is written. Returns the
+ * number of bytes queued.
+ */
+size_t serial_port_write(const void *data, size_t len, bool all);
+
+/** Takes up to @p max received bytes without waiting. Single reader. */
+size_t serial_port_read(void *data, size_t max);
+
+/** Received bytes lost to UART overruns or a full RX ring. */
+uint32_t serial_port_rx_dropped();
+
+/** Waits up to @p timeout_ms for the TX ring and the UART to drain. */
+bool serial_port_flush(uint32_t timeout_ms);
+
+/** Routes console output to @p sink, or back to the UART with nullptr. */
+void serial_port_set_console_sink(serial_console_sink_t sink);
+
+#endif // SERIAL_PORT_H
@@ -0,0 +1,35 @@
+/**
+ * @file shell.h
+ * @brief Line-based command shell on the serial console
+ *
+ * shell_poll() takes whatever the serial port has received, echoes it,
+ * handles backspace and runs a command for every completed line. It never
+ * waits for input, so it can share a polling thread (see main.cpp, log
+ * thread). Lines are split at spaces into at most SHELL_MAX_ARGS words; the
+ * first selects the command from the table passed to shell_init(), "help"
+ * lists the table.
+ */
+
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <stddef.h>
+
+#ifndef SHELL_LINE_MAX
+#define SHELL_LINE_MAX 64
+#endif
+#define SHELL_MAX_ARGS 6
+
+struct ShellCommand {
+  const char *name;
+  const char *usage; // arguments, for help
+  const char *help;
+  void (*run)(int argc, char **argv); // argv[0] is the command name
+};
+
+void shell_init(const ShellCommand *commands, size_t count);
+
+/** Processes pending input; single caller. */
+void shell_poll();
+
+#endif // SHELL_H
@@ -0,0 +1,168 @@
+/**
+ * @file stable_capture.h
+ * @brief Calibration point capture with stability detection and outlier
+ *        rejection
+ *
+ * Fed with one raw sample per acquisition cycle:
+ * 1. SETTLE: keeps the variance over the last CAPTURE_WINDOW samples and
+ *    waits until it drops to CAPTURE_STABLE_VAR or below (rod at rest).
+ *    An isolated sample far off the window mean is skipped as a spike; two
+ *    in a row are real movement and enter the window. Gives up after
+ *    CAPTURE_SETTLE_MAX samples.
+ * 2. COLLECT: takes CAPTURE_SAMPLES samples. A sample further than
+ *    CAPTURE_REJECT_SIGMA standard deviations (of the settled window, at
+ *    least one count) from the settled mean is rejected; the rest feed the
+ *    result. Too many rejections mean the rod moved: the capture fails.
+ *
+ * Sums are kept in integers; only the variances are evaluated in float.
+ * Header-only and free of mbed dependencies so it builds on the host.
+ */
+
+#ifndef STABLE_CAPTURE_H
+#define STABLE_CAPTURE_H
+
+#include <stdint.h>
+
+#ifndef CAPTURE_WINDOW
+#define CAPTURE_WINDOW 256 // settle window, samples
+#endif
+#ifndef CAPTURE_STABLE_VAR
+#define CAPTURE_STABLE_VAR 4.0f // counts^2
+#endif
+#ifndef CAPTURE_SETTLE_MAX
+#define CAPTURE_SETTLE_MAX 10000 // samples, 20 s at 2 ms
+#endif
+#ifndef CAPTURE_SAMPLES
+#define CAPTURE_SAMPLES 2048 // samples averaged per point
+#endif
+#ifndef CAPTURE_REJECT_SIGMA
+#define CAPTURE_REJECT_SIGMA 4
+#endif
+#ifndef CAPTURE_MAX_REJECT_PERMILLE
+#define CAPTURE_MAX_REJECT_PERMILLE 100
+#endif
+
+enum CaptureResult { CAPTURE_RUNNING, CAPTURE_DONE, CAPTURE_UNSTABLE };
+
+class StableCapture {
+public:
+  StableCapture() { start(); }
+
+  void start() {
+    collecting_ = false;
+    settle_count_ = 0;
+    last_spike_ = false;
+    win_head_ = 0;
+    win_count_ = 0;
+    win_sum_ = 0;
+    win_sumsq_ = 0;
+    ref_mean_ = 0;
+    reject_dist2_ = 0;
+    accepted_ = 0;
+    rejected_ = 0;
+    sum_ = 0;
+    sumsq_ = 0;
+  }
+
+  CaptureResult add(uint16_t raw) {
+    return collecting_ ? collect(raw) : settle(raw);
+  }
+
+  // Result of a finished capture (CAPTURE_DONE)
+  uint16_t mean() const {
+    return accepted_ ? (uint16_t)((sum_ + accepted_ / 2) / accepted_) : 0;
+  }
+  float variance() const {
+    return accepted_ ? variance_of(sum_, sumsq_, accepted_) : 0.0f;
+  }
+  uint32_t accepted() const { return accepted_; }
+  uint32_t rejected() const { return rejected_; }
+  uint32_t settle_samples() const { return settle_count_; }
+  bool collecting() const { return collecting_; }
+
+private:
+  static constexpr float kSpikeDist2 =
+      CAPTURE_REJECT_SIGMA * CAPTURE_REJECT_SIGMA * CAPTURE_STABLE_VAR;
+
+  static float variance_of(uint64_t sum, uint64_t sumsq, uint32_t n) {
+    // n * sumsq - sum^2 is exact in 64 bits for 12-bit samples and
+    // n <= CAPTURE_SAMPLES.
+    int64_t num = (int64_t)(sumsq * n) - (int64_t)(sum * sum);
+    return num > 0 ? (float)num / ((float)n * (float)n) : 0.0f;
+  }
+
+  CaptureResult settle(uint16_t raw) {
+    settle_count_++;
+    if (win_count_ == CAPTURE_WINDOW) {
+      int32_t d = (int32_t)raw - (int32_t)(win_sum_ / win_count_);
+      bool spike = (float)(d * d) > kSpikeDist2;
+      if (spike && !last_spike_) {
+        last_spike_ = true;
+        return settle_count_ >= CAPTURE_SETTLE_MAX ? CAPTURE_UNSTABLE
+                                                   : CAPTURE_RUNNING;
+      }
+      last_spike_ = spike;
+
+      uint16_t old = window_[win_head_];
+      win_sum_ -= old;
+      win_sumsq_ -= (uint32_t)old * old;
+    } else {
+      win_count_++;
+    }
+    window_[win_head_] = raw;
+    win_head_ = (uint16_t)((win_head_ + 1) % CAPTURE_WINDOW);
+    win_sum_ += raw;
+    win_sumsq_ += (uint32_t)raw * raw;
+
+    if (win_count_ == CAPTURE_WINDOW &&
+        variance_of(win_sum_, win_sumsq_, win_count_) <= CAPTURE_STABLE_VAR) {
+      ref_mean_ = (int32_t)(win_sum_ / win_count_);
+      float sigma2 = variance_of(win_sum_, win_sumsq_, win_count_);
+      // Squared rejection bound, at least one count.
+      float bound = (float)(CAPTURE_REJECT_SIGMA * CAPTURE_REJECT_SIGMA) *
+                    (sigma2 < 1.0f ? 1.0f : sigma2);
+      reject_dist2_ = (uint32_t)bound;
+      collecting_ = true;
+      return CAPTURE_RUNNING;
+    }
+    return settle_count_ >= CAPTURE_SETTLE_MAX ? CAPTURE_UNSTABLE
+                                               : CAPTURE_RUNNING;
+  }
+
+  CaptureResult collect(uint16_t raw) {
+    int32_t d = (int32_t)raw - ref_mean_;
+    if ((uint32_t)(d * d) > reject_dist2_) {
+      rejected_++;
+    } else {
+      accepted_++;
+      sum_ += raw;
+      sumsq_ += (uint32_t)raw * raw;
+    }
+    if (rejected_ * 1000U >
+        (uint32_t)CAPTURE_SAMPLES * CAPTURE_MAX_REJECT_PERMILLE)
+      return CAPTURE_UNSTABLE;
+    return accepted_ + rejected_ >= CAPTURE_SAMPLES ? CAPTURE_DONE
+                                                    : CAPTURE_RUNNING;
+  }
+
+  bool collecting_;
+  bool last_spike_;
+  uint32_t settle_count_;
+
+  // Settle window
+  uint16_t window_[CAPTURE_WINDOW];
+  uint16_t win_head_;
+  uint16_t win_count_;
+  uint64_t win_sum_;
+  uint64_t win_sumsq_;
+
+  // Collection against the settled reference
+  int32_t ref_mean_;
+  uint32_t reject_dist2_;
+  uint32_t accepted_;
+  uint32_t rejected_;
+  uint64_t sum_;
+  uint64_t sumsq_;
+};
+
+#endif // STABLE_CAPTURE_H
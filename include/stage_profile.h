@@ -0,0 +1,75 @@
+/**
+ * @file stage_profile.h
+ * @brief Per-stage cycle counts of the acquisition pipeline (DWT CYCCNT)
+ *
+ * A StageTimer placed at the top of a function (or block) adds the cycles
+ * until the end of its scope to that stage: call count, min, max and sum,
+ * from which the mean is derived. Stages may nest; the outer one then
+ * includes the time of the inner ones.
+ *
+ * The cost per timed scope is two CYCCNT reads and a short critical
+ * section; with STAGE_PROFILE_ENABLE=0 StageTimer is empty and the
+ * functions are not built.
+ */
+
+#ifndef STAGE_PROFILE_H
+#define STAGE_PROFILE_H
+
+#include <stdint.h>
+
+#include "cycle_counter.h"
+
+#ifndef STAGE_PROFILE_ENABLE
+#define STAGE_PROFILE_ENABLE 1
+#endif
+
+/* Stage ids; also the order on the timing page. */
+#define STAGE_READ 0     // read_sensor_raw_adc(), one sensor
+#define STAGE_CONVERT 1  // convert_raw_adc_to_mm(), one sensor
+#define STAGE_FORMAT 2   // format_sensor_data_fixed(), one diameter
+#define STAGE_PUBLISH 3  // legacy frame publish + DR restage request
+#define STAGE_EXT_PAGE 4 // extended stream page rebuild + publish
+#define STAGE_COUNT 5
+
+struct StageSnapshot {
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint32_t mean_cycles;
+};
+
+#if STAGE_PROFILE_ENABLE
+
+void stage_profile_add(uint8_t stage, uint32_t cycles);
+
+/** Consistent copy of one stage; callable from any thread. */
+void stage_profile_get(uint8_t stage, StageSnapshot *out);
+
+class StageTimer {
+public:
+  explicit StageTimer(uint8_t stage)
+      : stage_(stage), start_(cycle_counter_now()) {}
+  ~StageTimer() { stage_profile_add(stage_, cycle_counter_now() - start_); }
+
+private:
+  uint8_t stage_;
+  uint32_t start_;
+};
+
+#else
+
+static inline void stage_profile_get(uint8_t, StageSnapshot *out) {
+  *out = StageSnapshot{0, 0, 0, 0};
+}
+
+class StageTimer {
+public:
+  explicit StageTimer(uint8_t) {}
+};
+
+#endif // STAGE_PROFILE_ENABLE
+
+/** Short stage name for printing. */
+const char *stage_profile_name(uint8_t stage);
+
+#endif // STAGE_PROFILE_H
@@ -0,0 +1,95 @@
+/**
+ * @file supervisor.h
+ * @brief IWDG supervisor with per-channel check-ins and a reset record
+ *
+ * Every supervised channel (acquisition cycle, I2C service loop) calls
+ * supervisor_check_in() as part of its normal work. A ticker ISR kicks the
+ * independent watchdog only while every enabled channel has checked in
+ * within its deadline; once one misses, the kicks stop, the failing channels
+ * are written to the reset record and the IWDG resets the core within
+ * SUPERVISOR_WDG_TIMEOUT_MS. A wedged ISR or a disabled ticker stops the
+ * kicks as well.
+ *
+ * The record lives in RTC backup registers BKP16R..BKP19R, which survive a
+ * system reset (not a power loss). supervisor_init() reads the record left
+ * by the previous boot together with the hardware reset reason; after that
+ * the record tracks the running boot.
+ */
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+/* Channel ids; also bit positions in masks. */
+#define SUPERVISOR_CH_ACQ 0
+#define SUPERVISOR_CH_I2C 1
+#define SUPERVISOR_CH_COUNT 2
+
+/* Check-in deadlines in milliseconds. */
+#ifndef SUPERVISOR_ACQ_DEADLINE_MS
+#define SUPERVISOR_ACQ_DEADLINE_MS 20
+#endif
+#ifndef SUPERVISOR_I2C_DEADLINE_MS
+#define SUPERVISOR_I2C_DEADLINE_MS 300
+#endif
+
+/* IWDG timeout and the supervisor check/kick period, in milliseconds. */
+#ifndef SUPERVISOR_WDG_TIMEOUT_MS
+#define SUPERVISOR_WDG_TIMEOUT_MS 50
+#endif
+#ifndef SUPERVISOR_POLL_MS
+#define SUPERVISOR_POLL_MS 5
+#endif
+
+/* SupervisorRecord::reset_reason, coarse hardware reset cause */
+#define SUPERVISOR_RESET_POWER_ON 0
+#define SUPERVISOR_RESET_PIN 1
+#define SUPERVISOR_RESET_SOFTWARE 2
+#define SUPERVISOR_RESET_WATCHDOG 3
+#define SUPERVISOR_RESET_BROWN_OUT 4
+#define SUPERVISOR_RESET_OTHER 5
+
+struct SupervisorRecord {
+  bool valid;           // false after a power loss (backup domain reset)
+  uint8_t reset_reason; // SUPERVISOR_RESET_* that ended that boot
+  uint8_t missed_mask;  // channels that missed their deadline, if any
+  uint16_t boot_count;  // boots since the backup domain was reset
+  uint32_t uptime_ms;   // supervised run time at the last poll
+  // Time since each channel's last check-in at the last poll, saturated.
+  uint16_t age_ms[SUPERVISOR_CH_COUNT];
+};
+
+/**
+ * Reads and clears the reset cause, loads the previous boot's record and
+ * starts a new one. Call early in main(), before supervisor_start().
+ */
+void supervisor_init();
+
+/**
+ * Starts the IWDG and the supervision ticker for the channels in
+ * @p channel_mask (bit per SUPERVISOR_CH_*). The watchdog cannot be stopped
+ * again.
+ */
+void supervisor_start(uint32_t channel_mask);
+
+/**
+ * Stretches the IWDG timeout to at least @p max_ms and pauses the deadline
+ * checks, for operations that legitimately stall the core (flash erase).
+ * Every suspend must be followed by supervisor_resume().
+ */
+void supervisor_suspend(uint32_t max_ms);
+
+/** Restores the IWDG timeout and restarts all deadlines from now. */
+void supervisor_resume();
+
+/** Marks @p channel alive; callable from any context. */
+void supervisor_check_in(uint8_t channel);
+
+/** Record of the previous boot as found by supervisor_init(). */
+const SupervisorRecord &supervisor_previous();
+
+/** Human-readable SUPERVISOR_RESET_* name. */
+const char *supervisor_reset_name(uint8_t reason);
+
+#endif // SUPERVISOR_H
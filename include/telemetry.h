@@ -0,0 +1,67 @@
+/**
+ * @file telemetry.h
+ * @brief Binary stream of every acquisition cycle on the serial port
+ *
+ * telemetry_start() switches the serial port to TELEMETRY_BAUD; from then
+ * on the acquisition thread sends one TELEM_TYPE_SAMPLE packet per cycle
+ * (see telemetry_frame.h), so a host sees every sample instead of the
+ * latest one per I2C poll. Console output is collected in a text ring and
+ * sent by the same thread as TELEM_TYPE_TEXT packets, which keeps a single
+ * writer on the stream. A TELEM_TYPE_STATUS packet with the counters
+ * follows every TELEMETRY_STATUS_PERIOD_MS.
+ *
+ * Nothing waits for the link: a sample that does not fit into the serial
+ * TX ring is dropped and counted, and so is console text that overflows
+ * the text ring. telemetry_stop() returns the port to the console rate.
+ *
+ * USART2 runs from PCLK1 (45 MHz) with an integer divider n >= 8, so only
+ * rates of the form 45 MHz / n are exact: 1.5 Mbaud (n = 30) is the
+ * default; 2 Mbaud ends up at 2.045 Mbaud (+2.3 %), which only tolerant
+ * receivers accept. A sample packet is 30 bytes per cycle (15 kB/s at
+ * 2 ms).
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#ifndef TELEMETRY_BAUD
+#define TELEMETRY_BAUD 1500000
+#endif
+#ifndef TELEMETRY_STATUS_PERIOD_MS
+#define TELEMETRY_STATUS_PERIOD_MS 1000
+#endif
+#ifndef TELEMETRY_TEXT_RING_SIZE
+#define TELEMETRY_TEXT_RING_SIZE 1024 // power of two
+#endif
+/* Start streaming at boot (after the banner) instead of on request. */
+#ifndef TELEMETRY_AUTOSTART
+#define TELEMETRY_AUTOSTART 0
+#endif
+
+struct TelemetryStats {
+  bool active;
+  uint32_t baud;
+  uint32_t samples_sent;
+  uint32_t samples_dropped;
+  uint32_t text_dropped;
+};
+
+/**
+ * Start and stop wait for queued output to drain (bounded by the TX ring at
+ * the console rate). Control thread only, never the acquisition thread.
+ */
+void telemetry_start(uint32_t period_us);
+void telemetry_stop();
+
+bool telemetry_active();
+
+/** Acquisition thread, once per cycle; returns at once while inactive. */
+void telemetry_push_sample(uint32_t cycle, uint32_t t_us, uint16_t raw1,
+                           uint16_t raw2, float mm1, float mm2,
+                           uint16_t status);
+
+void telemetry_get_stats(TelemetryStats *out);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,87 @@
+/**
+ * @file telemetry_frame.h
+ * @brief Packets of the binary telemetry stream on the serial port
+ *
+ * While a stream runs the serial port carries nothing but packets:
+ *
+ *   0xA5 0x5A | type | len | seq (u16) | payload[len] | crc (u16)
+ *
+ * Multi-byte fields are little-endian. seq counts the packets queued for
+ * the link, of every type, so a gap means packets lost or corrupted on the
+ * way; samples dropped before the link (TX ring full) show up as gaps in
+ * TelemSample::cycle and in TelemStatus::samples_dropped. crc is
+ * CRC-16/CCITT-FALSE (ext_crc16) over type, len, seq and the payload. A
+ * receiver resynchronizes by searching for the sync bytes and discarding
+ * candidates whose CRC does not match.
+ *
+ * - TELEM_TYPE_SAMPLE: one per acquisition cycle (TelemSample).
+ * - TELEM_TYPE_STATUS: link counters, about once per second (TelemStatus).
+ * - TELEM_TYPE_TEXT: console output, up to TELEM_TEXT_MAX bytes of text.
+ *
+ * Shared between firmware and host tools; keep it free of mbed includes.
+ */
+
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ext_frame.h"
+
+#define TELEM_SYNC0 0xA5
+#define TELEM_SYNC1 0x5A
+#define TELEM_VERSION 1
+
+#define TELEM_TYPE_SAMPLE 0x01
+#define TELEM_TYPE_STATUS 0x02
+#define TELEM_TYPE_TEXT 0x03
+
+#define TELEM_TEXT_MAX 64
+
+struct __attribute__((packed)) TelemHeader {
+  uint8_t sync[2]; // TELEM_SYNC0, TELEM_SYNC1
+  uint8_t type;    // TELEM_TYPE_*
+  uint8_t len;     // payload bytes
+  uint16_t seq;    // packet counter, all types
+};
+
+struct __attribute__((packed)) TelemSample {
+  uint32_t cycle;  // acquisition cycle number (ExtSample::seq)
+  uint32_t t_us;   // cycle timestamp (uptime, wraps after ~71 min)
+  uint16_t raw[2]; // burst-averaged 12-bit ADC values
+  float mm[2];     // converted diameters
+  uint16_t status; // EXT_STATUS_* bits
+};
+
+struct __attribute__((packed)) TelemStatus {
+  uint8_t version; // TELEM_VERSION
+  uint8_t reserved[3];
+  uint32_t baud;            // rate actually set on the port
+  uint32_t period_us;       // acquisition period
+  uint32_t samples_sent;    // since the stream started
+  uint32_t samples_dropped; // did not fit into the TX ring
+  uint32_t text_dropped;    // console bytes lost, same reason
+};
+
+#define TELEM_OVERHEAD (sizeof(TelemHeader) + 2U)
+#define TELEM_PACKET_MAX (TELEM_OVERHEAD + 255U)
+
+/** Builds a packet in @p out (TELEM_OVERHEAD + len bytes), returns its size. */
+static inline size_t telem_encode(uint8_t *out, uint8_t type, uint16_t seq,
+                                  const void *payload, uint8_t len) {
+  TelemHeader h;
+  h.sync[0] = TELEM_SYNC0;
+  h.sync[1] = TELEM_SYNC1;
+  h.type = type;
+  h.len = len;
+  h.seq = seq;
+  memcpy(out, &h, sizeof(h));
+  memcpy(out + sizeof(h), payload, len);
+  uint16_t crc = ext_crc16(out + 2, sizeof(h) - 2U + len);
+  memcpy(out + sizeof(h) + len, &crc, sizeof(crc));
+  return sizeof(h) + len + sizeof(crc);
+}
+
+#endif // TELEMETRY_FRAME_H
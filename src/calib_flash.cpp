@@ -0,0 +1,39 @@
+/**
+ * @file calib_flash.cpp
+ * @brief FlashIAP implementation of the calibration log backend
+ */
+
+#include "calib_flash.h"
+
+#include "supervisor.h"
+
+bool CalibFlashIAP::init() {
+  if (flash_.init() != 0)
+    return false;
+  // Refuse to run over a layout that does not match the reserved sectors.
+  return flash_.get_sector_size(CALIB_FLASH_SECTOR_A_ADDR) ==
+             CALIB_FLASH_SECTOR_SIZE &&
+         flash_.get_sector_size(CALIB_FLASH_SECTOR_B_ADDR) ==
+             CALIB_FLASH_SECTOR_SIZE;
+}
+
+bool CalibFlashIAP::read(uint8_t sector, uint32_t offset, void *buf,
+                         uint32_t len) {
+  if (offset + len > CALIB_FLASH_SECTOR_SIZE)
+    return false;
+  return flash_.read(buf, address(sector, offset), len) == 0;
+}
+
+bool CalibFlashIAP::program(uint8_t sector, uint32_t offset, const void *buf,
+                            uint32_t len) {
+  if (offset + len > CALIB_FLASH_SECTOR_SIZE)
+    return false;
+  return flash_.program(buf, address(sector, offset), len) == 0;
+}
+
+bool CalibFlashIAP::erase(uint8_t sector) {
+  supervisor_suspend(CALIB_FLASH_ERASE_MAX_MS);
+  int rc = flash_.erase(address(sector, 0), CALIB_FLASH_SECTOR_SIZE);
+  supervisor_resume();
+  return rc == 0;
+}
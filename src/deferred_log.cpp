@@ -0,0 +1,142 @@
+/**
+ * @file deferred_log.cpp
+ * @brief Lock-free log ring and its formatter (see deferred_log.h)
+ */
+
+#include "deferred_log.h"
+
+#include <atomic>
+#include <stdio.h>
+
+#include "mbed.h"
+
+static_assert((LOG_RING_LEN & (LOG_RING_LEN - 1)) == 0,
+              "LOG_RING_LEN must be a power of two");
+
+#define LOG_MASK (LOG_RING_LEN - 1U)
+
+// A record is published by storing seq with release semantics after its
+// fields; the reader loads seq with acquire before reading them. The same
+// pairing on tail keeps a writer from reusing a slot still being read.
+struct LogRecord {
+  std::atomic<uint32_t> seq; // ring position + 1 once complete
+  const char *fmt;
+  uint8_t nargs;
+  LogWord args[LOG_MAX_ARGS];
+};
+
+static LogRecord ring[LOG_RING_LEN];
+static volatile uint32_t head = 0; // records claimed
+static std::atomic<uint32_t> tail(0); // records consumed (reader writes)
+static volatile uint32_t dropped = 0;
+
+void deferred_log_write(const char *fmt, const LogWord *args,
+                        uint8_t nargs) {
+  uint32_t pos = head;
+  do {
+    if (pos - tail.load(std::memory_order_acquire) >= LOG_RING_LEN) {
+      core_util_atomic_incr_u32(&dropped, 1);
+      return;
+    }
+  } while (!core_util_atomic_cas_u32(&head, &pos, pos + 1U));
+
+  LogRecord &r = ring[pos & LOG_MASK];
+  r.fmt = fmt;
+  r.nargs = nargs;
+  for (uint8_t i = 0; i < nargs; i++)
+    r.args[i] = args[i];
+  r.seq.store(pos + 1U, std::memory_order_release);
+}
+
+// Expands one record into @p out. Each conversion is handed to snprintf
+// together with its own argument, typed by the conversion character.
+static void format_record(const LogRecord &r, char *out, size_t size) {
+  const char *f = r.fmt;
+  size_t pos = 0;
+  uint8_t arg = 0;
+  char spec[16];
+
+  while (*f != '\0' && pos + 1 < size) {
+    if (*f != '%') {
+      out[pos++] = *f++;
+      continue;
+    }
+    if (f[1] == '%') {
+      out[pos++] = '%';
+      f += 2;
+      continue;
+    }
+
+    size_t n = 0;
+    bool is_long = false;
+    spec[n++] = *f++;
+    while (*f != '\0' && strchr("diuxXcfeEgGsp", *f) == nullptr &&
+           n < sizeof(spec) - 2) {
+      is_long |= *f == 'l';
+      spec[n++] = *f++;
+    }
+    char conv = *f;
+    if (conv == '\0')
+      break;
+    spec[n++] = *f++;
+    spec[n] = '\0';
+
+    LogWord w = arg < r.nargs ? r.args[arg++] : 0;
+    int len;
+    switch (conv) {
+    case 'f':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G': {
+      uint32_t bits = (uint32_t)w;
+      float v;
+      memcpy(&v, &bits, sizeof(v));
+      len = snprintf(out + pos, size - pos, spec, (double)v);
+      break;
+    }
+    case 's':
+      len = snprintf(out + pos, size - pos, spec, (const char *)w);
+      break;
+    case 'p':
+      len = snprintf(out + pos, size - pos, spec, (void *)w);
+      break;
+    case 'd':
+    case 'i':
+    case 'c':
+      len = is_long ? snprintf(out + pos, size - pos, spec, (long)(int32_t)w)
+                    : snprintf(out + pos, size - pos, spec, (int)(int32_t)w);
+      break;
+    default: {
+      uint32_t u = (uint32_t)w;
+      len = is_long ? snprintf(out + pos, size - pos, spec, (unsigned long)u)
+                    : snprintf(out + pos, size - pos, spec, (unsigned)u);
+      break;
+    }
+    }
+    if (len < 0)
+      break;
+    pos += (size_t)len < size - pos ? (size_t)len : size - pos - 1;
+  }
+  out[pos] = '\0';
+}
+
+uint32_t deferred_log_drain(uint32_t max) {
+  static char line[LOG_LINE_MAX];
+  uint32_t n = 0;
+  uint32_t pos = tail.load(std::memory_order_relaxed);
+  while (n < max && pos != head) {
+    LogRecord &r = ring[pos & LOG_MASK];
+    if (r.seq.load(std::memory_order_acquire) != pos + 1U)
+      break; // claimed, still being filled
+    format_record(r, line, sizeof(line));
+    // The slot is free again once tail moves past it.
+    pos++;
+    tail.store(pos, std::memory_order_release);
+    fputs(line, stdout);
+    n++;
+  }
+  return n;
+}
+
+uint32_t deferred_log_dropped() { return dropped; }
@@ -0,0 +1,716 @@
+/**
+ * @file i2c_slave_dma.cpp
+ * @brief Register-level I2C1 slave with DMA transmit (STM32F446, I2C v1 IP)
+ *
+ * Transfer sequencing (RM0390, slave mode):
+ * - ADDR (EV1): reading SR1 then SR2 clears it; SR2.TRA gives the direction.
+ *   For reads the TX DMA stream is armed right after, SCL is stretched until
+ *   the first byte lands in DR.
+ * - AF: master NACKed the last byte it wants; ends a read.
+ * - STOPF: cleared by writing CR1; ends a write. A repeated START (ADDR while
+ *   a write is open) ends it as well.
+ * - BTF while the DMA stream is exhausted: the master keeps clocking past the
+ *   frame, so pad bytes are fed by hand.
+ *
+ * Pre-staging: DR is written with byte 0 of the primary frame while no
+ * transfer of ours is open, and again after every transfer and publish.
+ * The ADDR handler then only arms DMA for byte 1 onwards. Staging runs in
+ * the event ISR (restage requests pend the IRQ) so the frame source keeps a
+ * single reader context. Writing DR between the address ACK and the first
+ * data clock is harmless because ADDR is handled after it, with the staged
+ * pointer that matches DR.
+ *
+ * Recovery (i2c_slave_dma_service, thread context):
+ *   IDLE      -> failure seen (ISR error, timeout, stuck line): reset the
+ *                peripheral and turn SDA/SCL into released GPIO inputs
+ *                (a line is stuck once it stayed low for
+ *                I2C_SLAVE_STUCK_LINE_MS, see detect_failure())
+ *   RELEASED  -> lines idle: reinit slave, back to IDLE
+ *             -> SDA low, SCL high: clock out 9 SCL pulses + STOP
+ *             -> SCL held low by someone else: BACKOFF
+ *   BUS_CLEAR -> lines idle: reinit; otherwise BACKOFF
+ *   BACKOFF   -> waits (2, 4, 8 ... ms, capped), then RELEASED again
+ */
+
+#include "i2c_slave_dma.h"
+
+#include "cycle_counter.h"
+#include "i2c_trace.h"
+
+#include "PeripheralPins.h"
+#include "mbed.h"
+#include "pinmap.h"
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+#define I2C_SLAVE_SDA_PIN PB_9
+#define I2C_SLAVE_SCL_PIN PB_8
+#define I2C_SLAVE_GPIO GPIOB
+#define I2C_SLAVE_SDA_BIT 9U
+#define I2C_SLAVE_SCL_BIT 8U
+
+// Stuck-line check: each probe reads the lines for this long (several SCL
+// periods even at 100 kHz); a line counts as low only if every read is.
+#define I2C_STUCK_PROBE_US 30
+#define I2C_STUCK_PROBE_PERIOD_MS 1 // service period while a line is low
+
+// Half period of the bus-clear clock (~100 kHz, standard mode safe).
+#define I2C_BUS_CLEAR_HALF_PERIOD_US 5
+#define I2C_BUS_CLEAR_PULSES 9
+
+// DMA1 Stream 7, Channel 1 = I2C1_TX (RM0390 Table 28).
+#define I2C_TX_DMA_STREAM DMA1_Stream7
+#define I2C_TX_DMA_CHANNEL 1U
+#define I2C_TX_DMA_CLEAR_FLAGS                                                 \
+  (DMA_HIFCR_CTCIF7 | DMA_HIFCR_CHTIF7 | DMA_HIFCR_CTEIF7 |                    \
+   DMA_HIFCR_CDMEIF7 | DMA_HIFCR_CFEIF7)
+
+// OAR1 bit 14 must always be kept at 1 by software (RM0390 27.6.3).
+#define I2C_OAR1_BIT14 (1UL << 14)
+
+// ============================================================================
+// STATE
+// ============================================================================
+
+static i2c_slave_frame_source_t frame_source = nullptr;
+static i2c_slave_write_sink_t write_sink = nullptr;
+static uint8_t own_address8 = 0;
+static uint8_t own_address2_8 = 0;
+static uint32_t bus_frequency_hz = 0;
+
+static volatile bool tx_active = false;
+static volatile bool xfer_active = false;
+static volatile uint32_t bus_activity = 0; // ADDR/RXNE/STOPF seen by the ISR
+static volatile uint32_t xfer_start_us = 0;
+static volatile I2CSlaveStats stats = {};
+
+static uint8_t rx_buf[I2C_SLAVE_RX_MAX];
+static uint16_t rx_len = 0;
+static bool rx_active = false;
+static uint8_t xfer_addr_index = I2C_SLAVE_ADDR_PRIMARY;
+static bool xfer_is_tx = false;
+
+// Primary frame whose byte 0 currently sits in DR.
+static const uint8_t *staged_buf = nullptr;
+static uint16_t staged_len = 0;
+static bool staged_valid = false;
+static volatile bool stage_pending = false;
+
+static uint64_t stretch_ns_sum = 0;
+static uint32_t stretch_samples = 0;
+
+// Failure classes raised from the ISR, consumed by the service step.
+#define FAIL_BUS_ERROR (1UL << 0)
+#define FAIL_ARB_LOST (1UL << 1)
+#define FAIL_OVERRUN (1UL << 2)
+// Failure classes detected by the service step.
+#define FAIL_TIMEOUT (1UL << 3)
+#define FAIL_SDA_STUCK (1UL << 4)
+#define FAIL_SCL_STUCK (1UL << 5)
+static volatile uint32_t isr_failures = 0;
+
+enum RecoveryState { REC_IDLE, REC_RELEASED, REC_BUS_CLEAR, REC_BACKOFF };
+static RecoveryState rec_state = REC_IDLE;
+static uint32_t rec_backoff_ms = I2C_SLAVE_BACKOFF_MIN_MS;
+static uint32_t rec_started_us = 0;
+// Lines (FAIL_SDA_STUCK / FAIL_SCL_STUCK) low on every probe since
+// stuck_since_us, with bus_activity at stuck_activity throughout.
+static uint32_t stuck_lines = 0;
+static uint32_t stuck_since_us = 0;
+static uint32_t stuck_activity = 0;
+
+static EventFlags slave_events;
+static bool deep_sleep_locked = false;
+
+// ============================================================================
+// LOW-LEVEL HELPERS
+// ============================================================================
+
+static inline void clear_sr1_flag(uint32_t flag) {
+  // SR1 error flags are rc_w0; writing 1 to the other bits leaves them as-is.
+  I2C1->SR1 = ~flag & 0xFFFFU;
+}
+
+static void tx_dma_stop() {
+  I2C_TX_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+  while (I2C_TX_DMA_STREAM->CR & DMA_SxCR_EN) {
+  }
+  DMA1->HIFCR = I2C_TX_DMA_CLEAR_FLAGS;
+  tx_active = false;
+}
+
+static inline void xfer_begin() {
+  xfer_start_us = us_ticker_read();
+  xfer_active = true;
+}
+
+static inline void xfer_end() { xfer_active = false; }
+
+static void rx_finish() {
+  if (rx_active)
+    I2C_TRACE(I2C_TRACE_WRITE_END, rx_len ? rx_buf[0] : 0, rx_len);
+  if (rx_active && write_sink != nullptr)
+    write_sink(xfer_addr_index, rx_buf, rx_len);
+  rx_active = false;
+  rx_len = 0;
+}
+
+static void tx_dma_start(const uint8_t *buf, uint16_t len) {
+  DMA1->HIFCR = I2C_TX_DMA_CLEAR_FLAGS;
+  I2C_TX_DMA_STREAM->M0AR = (uint32_t)buf;
+  I2C_TX_DMA_STREAM->NDTR = len;
+  tx_active = true;
+  I2C_TX_DMA_STREAM->CR |= DMA_SxCR_EN;
+}
+
+// Loads byte 0 of the newest primary frame into DR. Caller guarantees that
+// no transfer of ours is in progress.
+static void stage_first_byte() {
+  stage_pending = false;
+  if (!(I2C1->CR1 & I2C_CR1_PE) || frame_source == nullptr)
+    return;
+  uint16_t len = 0;
+  const uint8_t *buf = frame_source(I2C_SLAVE_ADDR_PRIMARY, &len);
+  if (buf == nullptr || len == 0) {
+    staged_valid = false;
+    return;
+  }
+  staged_buf = buf;
+  staged_len = len;
+  I2C1->DR = buf[0];
+  staged_valid = true;
+}
+
+#if !I2C_SLAVE_NOSTRETCH
+static void record_stretch(uint32_t cycles) {
+  uint32_t ns = cycles_to_ns(cycles);
+  if (stretch_samples == 0 || ns < stats.stretch_ns_min)
+    stats.stretch_ns_min = ns;
+  if (ns > stats.stretch_ns_max)
+    stats.stretch_ns_max = ns;
+  stretch_ns_sum += ns;
+  stretch_samples++;
+}
+#endif
+
+static void configure_peripheral() {
+  tx_dma_stop();
+  staged_valid = false;
+
+  // Software reset clears a half-finished transfer, including a byte that
+  // may still be parked in DR.
+  I2C1->CR1 = I2C_CR1_SWRST;
+  I2C1->CR1 = 0;
+
+  uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+  I2C1->CR2 = (pclk1 / 1000000U) & I2C_CR2_FREQ;
+
+  // Fast mode, DUTY=0: Thigh + Tlow = 3 * CCR * Tpclk1.
+  uint32_t ccr = pclk1 / (3U * bus_frequency_hz);
+  if (ccr < 1U)
+    ccr = 1U;
+  I2C1->CCR = I2C_CCR_FS | (ccr & I2C_CCR_CCR);
+  I2C1->TRISE = (pclk1 / 1000000U) * 300U / 1000U + 1U;
+
+  I2C1->OAR1 = I2C_OAR1_BIT14 | (own_address8 & I2C_OAR1_ADD1_7);
+  I2C1->OAR2 = own_address2_8
+                   ? (I2C_OAR2_ENDUAL | (own_address2_8 & I2C_OAR2_ADD2))
+                   : 0;
+
+  // DMA requests stay enabled; TXE is only serviced by the stream while a
+  // read is armed. Buffer interrupts (ITBUFEN) are switched on for writes.
+  I2C1->CR2 |= I2C_CR2_ITEVTEN | I2C_CR2_ITERREN | I2C_CR2_DMAEN;
+
+  uint32_t cr1 = I2C_CR1_PE;
+#if I2C_SLAVE_NOSTRETCH
+  cr1 |= I2C_CR1_NOSTRETCH;
+#endif
+  I2C1->CR1 = cr1;
+  I2C1->CR1 |= I2C_CR1_ACK; // ACK is cleared by hardware while PE=0
+
+  stage_first_byte();
+}
+
+// ============================================================================
+// INTERRUPT HANDLERS
+// ============================================================================
+
+static void i2c1_ev_isr() {
+  uint32_t t_entry = cycle_counter_now();
+  uint32_t sr1 = I2C1->SR1;
+  stats.irqs++;
+
+  if (sr1 & (I2C_SR1_ADDR | I2C_SR1_RXNE | I2C_SR1_STOPF))
+    bus_activity = bus_activity + 1U;
+
+  if (sr1 & I2C_SR1_ADDR) {
+    uint32_t sr2 = I2C1->SR2; // SR1 + SR2 read sequence clears ADDR
+    uint32_t t_addr_cleared = cycle_counter_now();
+
+    // Repeated START after a write (register-select then read).
+    rx_finish();
+    I2C1->CR2 &= ~I2C_CR2_ITBUFEN;
+
+    xfer_begin();
+    xfer_addr_index = (sr2 & I2C_SR2_DUALF) ? I2C_SLAVE_ADDR_SECONDARY
+                                            : I2C_SLAVE_ADDR_PRIMARY;
+
+    xfer_is_tx = (sr2 & I2C_SR2_TRA) != 0;
+    if (xfer_is_tx) {
+      // ReadAddressed: byte 0 is normally already in DR; DMA supplies the
+      // rest of the frame.
+      stats.reads++;
+      bool secondary = xfer_addr_index == I2C_SLAVE_ADDR_SECONDARY;
+      if (secondary)
+        stats.secondary_reads++;
+
+      const uint8_t *buf = nullptr;
+      uint16_t len = 0;
+      if (!secondary && staged_valid) {
+        buf = staged_buf;
+        len = staged_len;
+      } else if (frame_source != nullptr) {
+        buf = frame_source(xfer_addr_index, &len);
+      }
+
+      bool was_staged = staged_valid;
+      staged_valid = false;
+      if (was_staged) {
+        stats.staged_reads++;
+      } else {
+        // Nothing staged: feed byte 0 now (SCL is stretched until this write
+        // unless NOSTRETCH, in which case the slot may already be missed).
+        stats.unstaged_reads++;
+        I2C1->DR =
+            (buf != nullptr && len > 0) ? buf[0] : I2C_SLAVE_TX_PAD_BYTE;
+      }
+      uint32_t t_ready = cycle_counter_now();
+
+      if (buf != nullptr && len > 1) {
+        tx_dma_start(buf + 1, len - 1);
+      } else if (buf == nullptr) {
+        stats.tx_pad_bytes++;
+      }
+      I2C_TRACE(I2C_TRACE_ADDR_READ,
+                xfer_addr_index | (was_staged ? I2C_TRACE_STAGED : 0), len);
+
+#if I2C_SLAVE_NOSTRETCH
+      // Nothing to measure: the bus never waits for us.
+      (void)t_entry;
+      (void)t_addr_cleared;
+      (void)t_ready;
+#else
+      record_stretch((was_staged ? t_addr_cleared : t_ready) - t_entry);
+#endif
+    } else {
+      // WriteAddressed: collect bytes for the sink until STOP. Received
+      // bytes pass through DR, so the staged byte is gone; a read after a
+      // repeated START must not take it for granted.
+      staged_valid = false;
+      stats.writes++;
+      I2C_TRACE(I2C_TRACE_ADDR_WRITE, xfer_addr_index, 0);
+      rx_active = true;
+      rx_len = 0;
+      I2C1->CR2 |= I2C_CR2_ITBUFEN;
+    }
+    return;
+  }
+
+  if (sr1 & I2C_SR1_RXNE) {
+    uint8_t b = (uint8_t)I2C1->DR;
+    if (rx_len < I2C_SLAVE_RX_MAX)
+      rx_buf[rx_len++] = b;
+    else
+      stats.rx_dropped++;
+  }
+
+  if (sr1 & I2C_SR1_STOPF) {
+    I2C1->CR1 |= I2C_CR1_PE; // SR1 read + CR1 write clears STOPF
+    I2C1->CR2 &= ~I2C_CR2_ITBUFEN;
+    rx_finish();
+    if (tx_active)
+      tx_dma_stop();
+    xfer_end();
+    stage_first_byte();
+    return;
+  }
+
+  if (xfer_active && xfer_is_tx && (sr1 & I2C_SR1_BTF) &&
+      (sr1 & I2C_SR1_TXE) && I2C_TX_DMA_STREAM->NDTR == 0U) {
+    // Frame exhausted but the master keeps reading.
+    I2C1->DR = I2C_SLAVE_TX_PAD_BYTE;
+    stats.tx_pad_bytes++;
+    I2C_TRACE(I2C_TRACE_PAD, 0, 0);
+  }
+
+  // Restage request from the publisher (IRQ pended by software).
+  if (stage_pending && !xfer_active)
+    stage_first_byte();
+}
+
+static void i2c1_er_isr() {
+  uint32_t sr1 = I2C1->SR1;
+  stats.irqs++;
+
+  if (sr1 & I2C_SR1_AF) {
+    // NACK from the master: normal end of a read.
+    clear_sr1_flag(I2C_SR1_AF);
+    bool parked_byte = tx_active && !(sr1 & I2C_SR1_TXE);
+    I2C_TRACE(I2C_TRACE_READ_END, parked_byte, 0);
+    if (tx_active)
+      tx_dma_stop();
+    xfer_end();
+    if (parked_byte) {
+      // DMA already refilled DR for a byte the master never took; it would
+      // lead the next read. Reset the peripheral to drop it (restages).
+      stats.partial_reads++;
+      configure_peripheral();
+    } else {
+      // STOPF is not raised after a NACK, so restage here.
+      stage_first_byte();
+    }
+  }
+
+#if I2C_SLAVE_NOSTRETCH
+  if ((sr1 & I2C_SR1_OVR) && xfer_is_tx) {
+    // Transmit underrun: the shifter resent the last byte. Not a bus fault.
+    clear_sr1_flag(I2C_SR1_OVR);
+    stats.tx_underruns++;
+    I2C_TRACE(I2C_TRACE_UNDERRUN, 0, 0);
+    sr1 &= ~I2C_SR1_OVR;
+  }
+#endif
+
+  uint32_t errors = sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR);
+  if (errors) {
+    uint32_t fail = 0;
+    if (errors & I2C_SR1_BERR)
+      fail |= FAIL_BUS_ERROR;
+    if (errors & I2C_SR1_ARLO)
+      fail |= FAIL_ARB_LOST;
+    if (errors & I2C_SR1_OVR)
+      fail |= FAIL_OVERRUN;
+    clear_sr1_flag(errors);
+    I2C_TRACE(I2C_TRACE_ERROR, 0, (uint16_t)errors);
+    if (tx_active)
+      tx_dma_stop();
+    xfer_end();
+    isr_failures |= fail;
+    slave_events.set(I2C_SLAVE_EVT_ERROR);
+  }
+}
+
+// ============================================================================
+// BUS RECOVERY
+// ============================================================================
+
+static inline bool sda_high() {
+  return (I2C_SLAVE_GPIO->IDR >> I2C_SLAVE_SDA_BIT) & 1U;
+}
+
+static inline bool scl_high() {
+  return (I2C_SLAVE_GPIO->IDR >> I2C_SLAVE_SCL_BIT) & 1U;
+}
+
+static inline void gpio_set_mode(uint32_t bit, uint32_t mode) {
+  I2C_SLAVE_GPIO->MODER =
+      (I2C_SLAVE_GPIO->MODER & ~(3UL << (bit * 2U))) | (mode << (bit * 2U));
+}
+
+static inline void scl_drive(bool high) {
+  I2C_SLAVE_GPIO->BSRR = high ? (1UL << I2C_SLAVE_SCL_BIT)
+                              : (1UL << (I2C_SLAVE_SCL_BIT + 16U));
+}
+
+static inline void sda_drive(bool high) {
+  I2C_SLAVE_GPIO->BSRR = high ? (1UL << I2C_SLAVE_SDA_BIT)
+                              : (1UL << (I2C_SLAVE_SDA_BIT + 16U));
+}
+
+// Takes the peripheral off the bus and leaves both lines as floating GPIO
+// inputs (the pins are already open-drain from the AF setup).
+static void release_bus() {
+  i2c_slave_dma_deinit();
+  I2C1->CR1 = I2C_CR1_SWRST;
+  I2C1->CR1 = 0;
+  xfer_end();
+  rx_active = false;
+  rx_len = 0;
+  gpio_set_mode(I2C_SLAVE_SDA_BIT, 0U); // input
+  gpio_set_mode(I2C_SLAVE_SCL_BIT, 0U);
+}
+
+// Standard bus clear (I2C spec 3.1.16): up to nine SCL pulses until the
+// device holding SDA lets go, then a STOP condition. Pins are open-drain
+// outputs, so they never drive high against another device.
+static void bus_clear() {
+  scl_drive(true);
+  sda_drive(true);
+  gpio_set_mode(I2C_SLAVE_SCL_BIT, 1U); // output
+  for (int i = 0; i < I2C_BUS_CLEAR_PULSES && !sda_high(); i++) {
+    scl_drive(false);
+    wait_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+    scl_drive(true);
+    wait_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  }
+  // STOP: SDA low -> high while SCL is high.
+  gpio_set_mode(I2C_SLAVE_SDA_BIT, 1U);
+  sda_drive(false);
+  wait_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  sda_drive(true);
+  wait_us(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  gpio_set_mode(I2C_SLAVE_SDA_BIT, 0U);
+  gpio_set_mode(I2C_SLAVE_SCL_BIT, 0U);
+}
+
+// Reads both lines for I2C_STUCK_PROBE_US and returns FAIL_SDA_STUCK /
+// FAIL_SCL_STUCK for each line that was low on every read. Traffic between
+// other devices toggles SCL (and SDA with it) well within the probe.
+static uint32_t probe_low_lines() {
+  uint32_t low = FAIL_SDA_STUCK | FAIL_SCL_STUCK;
+  uint32_t t0 = us_ticker_read();
+  do {
+    uint32_t idr = I2C_SLAVE_GPIO->IDR;
+    if (idr & (1UL << I2C_SLAVE_SDA_BIT))
+      low &= ~FAIL_SDA_STUCK;
+    if (idr & (1UL << I2C_SLAVE_SCL_BIT))
+      low &= ~FAIL_SCL_STUCK;
+  } while (low != 0 &&
+           (uint32_t)(us_ticker_read() - t0) < I2C_STUCK_PROBE_US);
+  return low;
+}
+
+static void stuck_reset() { stuck_lines = 0; }
+
+// Returns FAIL_* class bits or 0 and stores the delay until the next check
+// in @p next_ms. A line is reported stuck only after it read low on every
+// probe for I2C_SLAVE_STUCK_LINE_MS, while the peripheral kept reporting
+// the bus busy (SR2.BUSY) and saw no transfer of its own. Traffic between
+// the printer and other devices keeps toggling the lines, so the recovery
+// does not release and clock a live bus.
+static uint32_t detect_failure(uint32_t *next_ms) {
+  *next_ms = I2C_SLAVE_SERVICE_PERIOD_MS;
+  core_util_critical_section_enter();
+  uint32_t fail = isr_failures;
+  isr_failures = 0;
+  bool busy = xfer_active;
+  uint32_t started = xfer_start_us;
+  uint32_t activity = bus_activity;
+  core_util_critical_section_exit();
+
+  if (fail)
+    return fail;
+
+  if (busy) {
+    stuck_reset();
+    if ((uint32_t)(us_ticker_read() - started) >
+        I2C_SLAVE_XFER_TIMEOUT_MS * 1000U) {
+      return FAIL_TIMEOUT;
+    }
+    return 0;
+  }
+
+  uint32_t low = probe_low_lines();
+  if (low == 0 || !(I2C1->SR2 & I2C_SR2_BUSY)) {
+    stuck_reset();
+    return 0;
+  }
+  uint32_t now = us_ticker_read();
+  if ((low & stuck_lines) == 0 || activity != stuck_activity) {
+    // Start (or restart) the window.
+    stuck_lines = low;
+    stuck_since_us = now;
+    stuck_activity = activity;
+  } else {
+    stuck_lines &= low; // low on every probe so far
+  }
+  if ((uint32_t)(now - stuck_since_us) >= I2C_SLAVE_STUCK_LINE_MS * 1000U) {
+    uint32_t stuck = (stuck_lines & FAIL_SCL_STUCK) ? FAIL_SCL_STUCK
+                                                    : FAIL_SDA_STUCK;
+    stuck_reset();
+    return stuck;
+  }
+  *next_ms = I2C_STUCK_PROBE_PERIOD_MS;
+  return 0;
+}
+
+static void count_failures(uint32_t fail) {
+  core_util_critical_section_enter();
+  if (fail & FAIL_BUS_ERROR)
+    stats.bus_errors++;
+  if (fail & FAIL_ARB_LOST)
+    stats.arb_lost++;
+  if (fail & FAIL_OVERRUN)
+    stats.overruns++;
+  if (fail & FAIL_TIMEOUT)
+    stats.timeouts++;
+  if (fail & FAIL_SDA_STUCK)
+    stats.sda_stuck++;
+  if (fail & FAIL_SCL_STUCK)
+    stats.scl_stuck++;
+  core_util_critical_section_exit();
+}
+
+static void slave_init(uint8_t address8, uint8_t address2_8, uint32_t bus_hz,
+                       i2c_slave_frame_source_t source,
+                       i2c_slave_write_sink_t sink);
+
+static uint32_t finish_recovery() {
+  slave_init(own_address8, own_address2_8, bus_frequency_hz, frame_source,
+             write_sink);
+
+  uint32_t took_ms = (us_ticker_read() - rec_started_us) / 1000U;
+  I2C_TRACE(I2C_TRACE_REINIT, 1,
+            (uint16_t)(took_ms > 0xFFFFU ? 0xFFFFU : took_ms));
+  core_util_critical_section_enter();
+  stats.recoveries++;
+  if (took_ms > stats.recovery_ms_max)
+    stats.recovery_ms_max = took_ms;
+  core_util_critical_section_exit();
+
+  rec_state = REC_IDLE;
+  rec_backoff_ms = I2C_SLAVE_BACKOFF_MIN_MS;
+  stuck_reset();
+  return I2C_SLAVE_SERVICE_PERIOD_MS;
+}
+
+static uint32_t enter_backoff() {
+  rec_state = REC_BACKOFF;
+  uint32_t delay = rec_backoff_ms;
+  I2C_TRACE(I2C_TRACE_BACKOFF, 0, (uint16_t)delay);
+  rec_backoff_ms *= 2U;
+  if (rec_backoff_ms > I2C_SLAVE_BACKOFF_MAX_MS)
+    rec_backoff_ms = I2C_SLAVE_BACKOFF_MAX_MS;
+  return delay;
+}
+
+uint32_t i2c_slave_dma_service() {
+  switch (rec_state) {
+  case REC_IDLE: {
+    uint32_t next_ms;
+    uint32_t fail = detect_failure(&next_ms);
+    if (fail == 0)
+      return next_ms;
+    count_failures(fail);
+    I2C_TRACE(I2C_TRACE_FAILURE, 0, (uint16_t)fail);
+    rec_started_us = us_ticker_read();
+    release_bus();
+    rec_state = REC_RELEASED;
+    return 1; // let the lines settle
+  }
+
+  case REC_RELEASED:
+    if (sda_high() && scl_high())
+      return finish_recovery();
+    if (scl_high()) {
+      bus_clear();
+      I2C_TRACE(I2C_TRACE_BUS_CLEAR, 0, 0);
+      core_util_critical_section_enter();
+      stats.bus_clears++;
+      core_util_critical_section_exit();
+      rec_state = REC_BUS_CLEAR;
+      return 1;
+    }
+    // SCL held low by another device; nothing we can drive.
+    return enter_backoff();
+
+  case REC_BUS_CLEAR:
+    if (sda_high() && scl_high())
+      return finish_recovery();
+    return enter_backoff();
+
+  case REC_BACKOFF:
+  default:
+    rec_state = REC_RELEASED;
+    return 0;
+  }
+}
+
+bool i2c_slave_dma_recovering() { return rec_state != REC_IDLE; }
+
+void i2c_slave_dma_restage() {
+  stage_pending = true;
+  NVIC_SetPendingIRQ(I2C1_EV_IRQn);
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void i2c_slave_dma_init(uint8_t address8, uint8_t address2_8, uint32_t bus_hz,
+                        i2c_slave_frame_source_t source,
+                        i2c_slave_write_sink_t sink) {
+  slave_init(address8, address2_8, bus_hz, source, sink);
+  I2C_TRACE(I2C_TRACE_REINIT, 0, 0);
+}
+
+static void slave_init(uint8_t address8, uint8_t address2_8, uint32_t bus_hz,
+                       i2c_slave_frame_source_t source,
+                       i2c_slave_write_sink_t sink) {
+  NVIC_DisableIRQ(I2C1_EV_IRQn);
+  NVIC_DisableIRQ(I2C1_ER_IRQn);
+
+  own_address8 = address8;
+  own_address2_8 = address2_8;
+  bus_frequency_hz = bus_hz;
+  frame_source = source;
+  write_sink = sink;
+  rx_active = false;
+  rx_len = 0;
+
+  if (!deep_sleep_locked) {
+    sleep_manager_lock_deep_sleep();
+    deep_sleep_locked = true;
+  }
+
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_I2C1_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  pinmap_pinout(I2C_SLAVE_SDA_PIN, PinMap_I2C_SDA);
+  pinmap_pinout(I2C_SLAVE_SCL_PIN, PinMap_I2C_SCL);
+  // Bus pull-ups are provided by the printer side.
+  pin_mode(I2C_SLAVE_SDA_PIN, OpenDrainNoPull);
+  pin_mode(I2C_SLAVE_SCL_PIN, OpenDrainNoPull);
+
+  I2C_TX_DMA_STREAM->CR = 0;
+  while (I2C_TX_DMA_STREAM->CR & DMA_SxCR_EN) {
+  }
+  I2C_TX_DMA_STREAM->PAR = (uint32_t)&I2C1->DR;
+  I2C_TX_DMA_STREAM->CR = (I2C_TX_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) |
+                          DMA_SxCR_PL_1 | DMA_SxCR_MINC | DMA_SxCR_DIR_0;
+  I2C_TX_DMA_STREAM->FCR = 0; // direct mode, byte-wide peripheral
+
+  configure_peripheral();
+
+  NVIC_SetVector(I2C1_EV_IRQn, (uint32_t)&i2c1_ev_isr);
+  NVIC_SetVector(I2C1_ER_IRQn, (uint32_t)&i2c1_er_isr);
+  NVIC_ClearPendingIRQ(I2C1_EV_IRQn);
+  NVIC_ClearPendingIRQ(I2C1_ER_IRQn);
+  NVIC_EnableIRQ(I2C1_EV_IRQn);
+  NVIC_EnableIRQ(I2C1_ER_IRQn);
+}
+
+void i2c_slave_dma_deinit() {
+  NVIC_DisableIRQ(I2C1_EV_IRQn);
+  NVIC_DisableIRQ(I2C1_ER_IRQn);
+  tx_dma_stop();
+  I2C1->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITERREN | I2C_CR2_ITBUFEN |
+                 I2C_CR2_DMAEN);
+  I2C1->CR1 = 0;
+}
+
+uint32_t i2c_slave_dma_wait_for(uint32_t flags, uint32_t timeout_ms) {
+  return slave_events.wait_any_for(flags,
+                                   std::chrono::milliseconds(timeout_ms));
+}
+
+void i2c_slave_dma_get_stats(I2CSlaveStats *out) {
+  core_util_critical_section_enter();
+  memcpy(out, (const void *)&stats, sizeof(*out));
+  out->stretch_ns_mean =
+      stretch_samples ? (uint32_t)(stretch_ns_sum / stretch_samples) : 0;
+  core_util_critical_section_exit();
+}
@@ -0,0 +1,96 @@
+/**
+ * @file i2c_trace.cpp
+ * @brief Lock-free I2C event ring (see i2c_trace.h)
+ */
+
+#include "i2c_trace.h"
+
+#if I2C_DEBUG_ENABLE
+
+#include "cycle_counter.h"
+
+#include "mbed.h"
+
+static_assert((I2C_DEBUG_EVENT_QUEUE_LEN & (I2C_DEBUG_EVENT_QUEUE_LEN - 1)) ==
+                  0,
+              "I2C_DEBUG_EVENT_QUEUE_LEN must be a power of two");
+
+#define TRACE_MASK (I2C_DEBUG_EVENT_QUEUE_LEN - 1U)
+
+static I2CTraceEvent ring[I2C_DEBUG_EVENT_QUEUE_LEN];
+static volatile uint32_t head = 0; // events claimed so far
+static uint32_t tail = 0;          // next event to read (reader only)
+
+void i2c_trace_record(uint8_t type, uint8_t a, uint16_t b) {
+  uint32_t now = cycle_counter_now();
+  uint32_t pos = core_util_atomic_incr_u32(&head, 1) - 1U;
+  volatile I2CTraceEvent &e = ring[pos & TRACE_MASK];
+  e.seq = 0; // invalid while the fields change
+  e.cycles = now;
+  e.type = type;
+  e.a = a;
+  e.b = b;
+  e.seq = pos + 1U;
+}
+
+uint32_t i2c_trace_drain(I2CTraceEvent *out, uint32_t max, uint32_t *lost) {
+  uint32_t n = 0;
+  while (n < max) {
+    uint32_t claimed = head;
+    if (tail == claimed)
+      break;
+    if (claimed - tail > I2C_DEBUG_EVENT_QUEUE_LEN) {
+      // Lapped by the writers: skip to the oldest entry still in the ring.
+      *lost += claimed - tail - I2C_DEBUG_EVENT_QUEUE_LEN;
+      tail = claimed - I2C_DEBUG_EVENT_QUEUE_LEN;
+    }
+
+    volatile I2CTraceEvent &e = ring[tail & TRACE_MASK];
+    uint32_t seq = e.seq;
+    if (seq == 0 || (int32_t)(seq - (tail + 1U)) < 0)
+      break; // claimed but not complete yet
+    out[n].cycles = e.cycles;
+    out[n].type = e.type;
+    out[n].a = e.a;
+    out[n].b = e.b;
+    if (e.seq != tail + 1U) {
+      (*lost)++; // overwritten while copying, or already newer
+    } else {
+      out[n].seq = seq;
+      n++;
+    }
+    tail++;
+  }
+  return n;
+}
+
+const char *i2c_trace_name(uint8_t type) {
+  switch (type) {
+  case I2C_TRACE_ADDR_READ:
+    return "read";
+  case I2C_TRACE_ADDR_WRITE:
+    return "write";
+  case I2C_TRACE_READ_END:
+    return "read-end";
+  case I2C_TRACE_WRITE_END:
+    return "write-end";
+  case I2C_TRACE_PAD:
+    return "pad";
+  case I2C_TRACE_UNDERRUN:
+    return "underrun";
+  case I2C_TRACE_ERROR:
+    return "error";
+  case I2C_TRACE_FAILURE:
+    return "failure";
+  case I2C_TRACE_BUS_CLEAR:
+    return "bus-clear";
+  case I2C_TRACE_BACKOFF:
+    return "backoff";
+  case I2C_TRACE_REINIT:
+    return "reinit";
+  default:
+    return "?";
+  }
+}
+
+#endif // I2C_DEBUG_ENABLE
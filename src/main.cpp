@@ -7,7 +7,7 @@
  * Hardware:
  * - STM32F446RE Nucleo Board
  * - 2x Hall Effect Sensors (SS495A) on PA0/PA1 (ADC inputs)
- * - I2C1 Slave on PB8/PB9 for printer communication
+ * - I2C1 Slave on PB8/PB9 for printer communication (IRQ + DMA TX)
  * - USB Serial at 115200 baud
  * - Calibration buttons on PB6/D10 (Start) and PA9/D8 (Next)
  *
@@ -15,12 +15,34 @@
  * - SCL: PB8 - Connect to printer's I2C SCL D7
  * - SDA: PB9 - Connect to printer's I2C SDA D8
  * - GND: Common ground required
+ * - 0x42: legacy 10-byte digit frame (printer firmware)
+ * - 0x43: extended binary pages for tooling (see include/ext_frame.h)
  *
  * Framework: mbed OS
  */
 
 #include "mbed.h"
 
+#include "button_debounce.h"
+#include "calib_fit.h"
+#include "calib_flash.h"
+#include "calib_store.h"
+#include "cpu_load.h"
+#include "cycle_counter.h"
+#include "deferred_log.h"
+#include "drift_tracker.h"
+#include "ext_frame.h"
+#include "frame_publisher.h"
+#include "i2c_slave_dma.h"
+#include "i2c_trace.h"
+#include "period_stats.h"
+#include "serial_port.h"
+#include "shell.h"
+#include "stable_capture.h"
+#include "stage_profile.h"
+#include "supervisor.h"
+#include "telemetry.h"
+
 // ============================================================================
 // FIRMWARE CONFIGURATION
 // ============================================================================
@@ -31,23 +53,25 @@
 // PIN DEFINITIONS
 // ============================================================================
 
-// mbed I2CSlave::address expects the 8-bit form.
+// The slave driver expects the 8-bit form.
 // Keep this paired with printer `FILWIDTH_SENSOR_I2C_ADDRESS`:
 // addr8 = (addr7 << 1), e.g. 0x42 -> 0x84.
 #define SENSOR_I2C_ADDRESS 0x84
+// Second own address (OAR2) serving the extended stream, 7-bit 0x43.
+// Set to 0 to disable dual addressing.
+#define SENSOR_I2C_ADDRESS_EXT 0x86
 #define SENSOR_I2C_FREQUENCY_HZ 400000
 
 // ADC pins for Hall effect sensors
 AnalogIn sensor1(PA_0); // ADC1_IN0
 AnalogIn sensor2(PA_1); // ADC1_IN1
 
-// I2C slave
-I2CSlave i2c_slave(PB_9, PB_8); // SDA, SCL
+// I2C slave: PB_9 (SDA), PB_8 (SCL), driven by i2c_slave_dma.cpp
 
 // Digital outputs/inputs
 DigitalOut led(PA_5);
-DigitalIn cal_start_btn(PB_6, PullUp);
-DigitalIn cal_next_btn(PA_9, PullUp); // Arduino D8
+InterruptIn cal_start_btn(PB_6, PullUp);
+InterruptIn cal_next_btn(PA_9, PullUp); // Arduino D8
 
 // ============================================================================
 // GLOBAL VARIABLES
@@ -69,33 +93,198 @@ DigitalIn cal_next_btn(PA_9, PullUp); // Arduino D8
 /* Sensor Measurements */
 volatile float sensor1_mm = 1.75f;
 volatile float sensor2_mm = 1.75f;
+volatile uint16_t sensor_raw[2] = {0, 0};
+volatile uint32_t acq_cycle_count = 0;
+volatile bool calibration_active = false;
 
 /* Calibration Tables */
 struct CalibrationPoint {
   uint16_t raw_adc;
   float diameter_mm;
+  float raw_var; // capture variance in counts^2, 0 if not captured
 };
 
 CalibrationPoint calibration_tables[2][3] = {{// Sensor 1
-                                              {7, 1.47f},
-                                              {532, 1.68f},
-                                              {1119, 1.99f}},
+                                              {7, 1.47f, 0.0f},
+                                              {532, 1.68f, 0.0f},
+                                              {1119, 1.99f, 0.0f}},
                                              {// Sensor 2
-                                              {7, 1.47f},
-                                              {532, 1.68f},
-                                              {1119, 1.99f}}};
+                                              {7, 1.47f, 0.0f},
+                                              {532, 1.68f, 0.0f},
+                                              {1119, 1.99f, 0.0f}}};
+
+/* Least-squares curve that replaces a sensor's table in the conversion
+ * (see calib_fit.h); degree 0 means the table is used. */
+struct CalibFitModel {
+  uint8_t degree;
+  uint8_t count;    // points the curve was fitted to
+  uint16_t raw_min; // raw range of those points, where the curve is
+  uint16_t raw_max; // known to be monotonic
+  uint16_t reserved;
+  float center;
+  float coeff[3];
+  float rms_mm;
+  float r2;
+};
+
+CalibFitModel calibration_fits[2] = {};
+
+/* Conversion lookup derived from the tables (or fitted curves): per segment
+ * a quadratic around its base point, so the per-sample conversion needs no
+ * division. Two sets; the acquisition thread converts through
+ * active_conversion and replaces it by filling the other set and flipping
+ * the pointer between two cycles. */
+struct ConversionSegment {
+  float base_raw;
+  float base_mm;
+  float slope; // mm per count
+  float curve; // mm per count^2, 0 for table segments
+};
+
+struct SensorConversion {
+  uint16_t knee_raw; // raw values above it use the upper segment
+  uint16_t raw_lo;   // range the lookup is monotonic over: the table end
+  uint16_t raw_hi;   // points or the raw range of the fitted data
+  ConversionSegment seg[2];
+};
 
-/* I2C Communication Buffer */
-volatile uint8_t tx_buffer[10] = {0};
+struct ConversionSet {
+  SensorConversion sensor[2];
+};
+
+ConversionSet conversion_sets[2];
+ConversionSet *active_conversion = &conversion_sets[0];
 
-/* I2C Connection Status */
-volatile uint32_t i2c_request_count = 0;
-volatile uint64_t last_i2c_request_time_us = 0;
+/* Zero-point drift tracking (see drift_tracker.h). The estimators always
+ * run; the correction is applied in the conversion only when enabled. Off
+ * by default: it also absorbs filament that runs steadily off nominal, up
+ * to DRIFT_MAX_COUNTS (~0.047 mm), and reports it as 1.75 mm. */
+#ifndef DRIFT_CORRECTION_ENABLE
+#define DRIFT_CORRECTION_ENABLE 0
+#endif
+#define DRIFT_NOMINAL_MM 1.75f // long-run average diameter of the filament
+
+DriftTracker drift_trackers[2];
+volatile bool drift_correction_enabled = DRIFT_CORRECTION_ENABLE;
+
+/* Calibration persistence (log in flash sectors 6/7, see calib_store.h) */
+#define CALIB_FORMAT_PROFILES 1 // CalibProfileSet, see CALIBRATION
+
+CalibFlashIAP calib_flash;
+CalibStore<CalibFlashIAP> calib_store(calib_flash);
+bool calib_flash_ok = false;
+// Set on the acquisition thread, cleared by calibration_save().
+volatile bool calib_save_requested = false;
+volatile bool calib_flash_busy = false; // EXT_STATUS_FLASH_BUSY
+#define CALIB_HOUSEKEEPING_MS 1000 // save retries, idle-time erase
+#define CALIB_ERASE_IDLE_MS 5000   // no I2C traffic this long: erase spare
+#define CALIB_ERASE_ANNOUNCE_MS 10 // stream pages flagging the busy status
+
+/* I2C Communication Buffer (written by main loop, read by I2C ISR) */
+#define TX_FRAME_LEN 10
+FramePublisher<TX_FRAME_LEN> tx_frames;
+
+/* Extended Stream (secondary address, read by I2C ISR) */
+FramePublisher<sizeof(ExtStreamPage)> ext_stream_frames;
+FramePublisher<sizeof(ExtDiagPage)> ext_diag_frames;
+FramePublisher<sizeof(ExtTimingPage)> ext_timing_frames;
+FramePublisher<sizeof(ExtCalibPage)> ext_calib_frames;
+FramePublisher<sizeof(ExtFitPage)> ext_fit_frames;
+volatile uint8_t ext_page = EXT_PAGE_STREAM; // sticky, set by host write
+
+// Newest samples in acquisition order; owned by the acquisition thread.
+ExtSample ext_history[EXT_FIFO_DEPTH];
+uint8_t ext_history_head = 0;
+uint8_t ext_history_count = 0;
+
+#define EXT_DIAG_REFRESH_MS 100 // diag and timing pages, from main_queue
 
 /* Timing */
 Timer heartbeat_timer;
 Timer uptime_timer;
 
+/* Main Control Loop (buttons, calibration UI, serial reports) */
+#define BUTTON_DEBOUNCE_MS 50
+#define STATS_PRINT_PERIOD_MS 10000 // 0 disables the periodic report
+
+EventQueue main_queue(32 * EVENTS_EVENT_SIZE);
+
+/* Acquisition Thread (sampling, conversion, calibration capture, publish) */
+#define ACQ_PERIOD_US 2000
+#define ACQ_THREAD_PRIORITY osPriorityHigh
+
+EventQueue acq_queue(16 * EVENTS_EVENT_SIZE);
+Ticker acq_ticker;
+volatile bool acq_pending = false;
+volatile uint32_t acq_tick_cycles = 0; // DWT stamp of the pending tick
+volatile uint32_t acq_ticks_missed = 0;
+
+/* Threads with static stacks; sizes in bytes, overridable at build time.
+ * Usage high-water marks are reported by print_stack_usage() and on the diag
+ * page (needs platform.stack-stats-enabled, see mbed_app.json). The main
+ * thread stack is sized by rtos.main-thread-stack-size. */
+#ifndef I2C_THREAD_STACK_SIZE
+#define I2C_THREAD_STACK_SIZE 1536
+#endif
+#ifndef ACQ_THREAD_STACK_SIZE
+#define ACQ_THREAD_STACK_SIZE 1280
+#endif
+#ifndef LED_THREAD_STACK_SIZE
+#define LED_THREAD_STACK_SIZE 768
+#endif
+#ifndef LOG_DRAIN_PERIOD_MS
+#define LOG_DRAIN_PERIOD_MS 20 // log thread poll; the ring absorbs bursts
+#endif
+#ifndef LOG_THREAD_STACK_SIZE
+#define LOG_THREAD_STACK_SIZE 1536 // float formatting
+#endif
+
+MBED_ALIGN(8) static unsigned char i2c_thread_stack[I2C_THREAD_STACK_SIZE];
+MBED_ALIGN(8) static unsigned char acq_thread_stack[ACQ_THREAD_STACK_SIZE];
+MBED_ALIGN(8) static unsigned char led_thread_stack[LED_THREAD_STACK_SIZE];
+MBED_ALIGN(8) static unsigned char log_thread_stack[LOG_THREAD_STACK_SIZE];
+
+Thread i2c_thread(osPriorityRealtime, I2C_THREAD_STACK_SIZE, i2c_thread_stack,
+                  "i2c");
+Thread acq_thread(ACQ_THREAD_PRIORITY, ACQ_THREAD_STACK_SIZE, acq_thread_stack,
+                  "acq");
+Thread led_thread(osPriorityBelowNormal, LED_THREAD_STACK_SIZE,
+                  led_thread_stack, "led");
+Thread log_thread(osPriorityLow, LOG_THREAD_STACK_SIZE, log_thread_stack,
+                  "log");
+osThreadId_t main_thread_id = nullptr;
+
+/* Buttons (edge interrupt + settle timer on main_queue) */
+ButtonDebouncer cal_start_debounce;
+ButtonDebouncer cal_next_debounce;
+
+// Tick-to-publish latency of the acquisition path.
+volatile uint32_t acq_latency_ns_min = 0;
+volatile uint32_t acq_latency_ns_max = 0;
+uint64_t acq_latency_ns_sum = 0;
+uint32_t acq_latency_samples = 0;
+
+// Busy time per thread (DWT cycles, updated in a critical section).
+uint64_t acq_busy_cycles = 0;
+uint64_t i2c_busy_cycles = 0;
+
+// CPU load, sampled on main_queue every CPU_LOAD_SAMPLE_MS. The history is
+// main_queue's own; the windows are copied in and out in a critical section.
+static_assert(CPU_LOAD_THREADS == EXT_LOAD_THREADS, "diag page layout");
+CpuLoad cpu_load;
+CpuLoadReport cpu_load_1s = {};
+CpuLoadReport cpu_load_10s = {};
+
+// Pipeline stages are timed with StageTimer (stage_profile.h).
+static_assert(STAGE_COUNT == EXT_STAGE_COUNT, "timing page layout");
+
+// Start-to-start period of the acquisition cycle, stamped with CYCCNT right
+// before the ADC burst. Updated and read in a critical section.
+static_assert(PERIOD_HIST_BINS == EXT_HIST_BINS, "timing page layout");
+PeriodStats acq_period(ACQ_PERIOD_US * 1000U);
+uint32_t acq_last_start_cycles = 0;
+bool acq_period_started = false;
+
 // ============================================================================
 // FORWARD DECLARATIONS
 // ============================================================================
@@ -103,13 +292,27 @@ Timer uptime_timer;
 uint32_t mm_to_fixed_10000(float val);
 void format_sensor_data_fixed(uint32_t val_x10000, uint8_t *buf);
 void reinit_i2c_slave();
+void publish_sensor_frame(float mm1, float mm2);
+uint32_t acq_latency_ns_mean();
+void push_ext_sample(uint16_t raw1, uint16_t raw2, float mm1, float mm2);
+void publish_ext_stream();
+void publish_ext_calib();
+void publish_ext_fit();
+uint16_t mm_to_u16_x10000(float mm);
+void get_acq_period(PeriodSnapshot *out);
 uint64_t get_uptime_us();
+uint32_t busy_ms(const uint64_t *cycles);
+uint64_t busy_us(const uint64_t *cycles);
+void get_cpu_load(CpuLoadReport *load_1s, CpuLoadReport *load_10s);
+osThreadId_t thread_id(uint8_t ext_thread);
+void get_stack_usage(osThreadId_t id, uint16_t *used, uint16_t *size);
 
 // ============================================================================
 // SENSOR FUNCTIONS
 // ============================================================================
 
 uint16_t read_sensor_raw_adc(uint8_t sensor_idx) {
+  StageTimer timer(STAGE_READ);
   AnalogIn *sensor_pin = (sensor_idx == 0) ? &sensor1 : &sensor2;
 
   // Oversample with 16-sample burst (12-bit ADC)
@@ -123,91 +326,745 @@ uint16_t read_sensor_raw_adc(uint8_t sensor_idx) {
   return averaged;
 }
 
+static inline float conversion_eval(const SensorConversion &c,
+                                    uint16_t raw_adc) {
+  const ConversionSegment &seg = c.seg[raw_adc > c.knee_raw ? 1 : 0];
+  float d = (float)raw_adc - seg.base_raw;
+  return seg.base_mm + d * (seg.slope + d * seg.curve);
+}
+
 float convert_raw_adc_to_mm(uint16_t raw_adc, uint8_t sensor_idx) {
+  StageTimer timer(STAGE_CONVERT);
   if (sensor_idx >= 2) {
     return 1.75f;
   }
+  return conversion_eval(active_conversion->sensor[sensor_idx], raw_adc);
+}
 
-  const CalibrationPoint *table = calibration_tables[sensor_idx];
-  float diameter;
-
-  if (raw_adc <= table[1].raw_adc) {
-    int32_t denom = (int32_t)table[1].raw_adc - (int32_t)table[0].raw_adc;
-    if (denom == 0) {
-      diameter = table[0].diameter_mm;
-    } else {
-      float slope =
-          (table[1].diameter_mm - table[0].diameter_mm) / (float)denom;
-      diameter = table[0].diameter_mm +
-                 slope * (float)((int32_t)raw_adc - (int32_t)table[0].raw_adc);
+// Piecewise-linear lookup through the three points of each table (a
+// segment with equal raw ends is flat at its lower point), or the fitted
+// curve as a single segment where one is in use.
+void conversion_build(ConversionSet *set, const CalibrationPoint (*tables)[3],
+                      const CalibFitModel *fits) {
+  for (int s = 0; s < 2; s++) {
+    const CalibrationPoint *table = tables[s];
+    SensorConversion &c = set->sensor[s];
+    if (fits[s].degree != 0) {
+      c.knee_raw = 0xFFFF;
+      c.raw_lo = fits[s].raw_min;
+      c.raw_hi = fits[s].raw_max;
+      c.seg[0].base_raw = fits[s].center;
+      c.seg[0].base_mm = fits[s].coeff[0];
+      c.seg[0].slope = fits[s].coeff[1];
+      c.seg[0].curve = fits[s].coeff[2];
+      c.seg[1] = c.seg[0];
+      continue;
     }
-  } else {
-    int32_t denom = (int32_t)table[2].raw_adc - (int32_t)table[1].raw_adc;
-    if (denom == 0) {
-      diameter = table[1].diameter_mm;
-    } else {
-      float slope =
-          (table[2].diameter_mm - table[1].diameter_mm) / (float)denom;
-      diameter = table[1].diameter_mm +
-                 slope * (float)((int32_t)raw_adc - (int32_t)table[1].raw_adc);
+    c.knee_raw = table[1].raw_adc;
+    c.raw_lo = table[0].raw_adc < table[2].raw_adc ? table[0].raw_adc
+                                                   : table[2].raw_adc;
+    c.raw_hi = table[0].raw_adc < table[2].raw_adc ? table[2].raw_adc
+                                                   : table[0].raw_adc;
+    for (int k = 0; k < 2; k++) {
+      int32_t denom = (int32_t)table[k + 1].raw_adc - (int32_t)table[k].raw_adc;
+      c.seg[k].base_raw = (float)table[k].raw_adc;
+      c.seg[k].base_mm = table[k].diameter_mm;
+      float rise = table[k + 1].diameter_mm - table[k].diameter_mm;
+      c.seg[k].slope = denom == 0 ? 0.0f : rise / (float)denom;
+      c.seg[k].curve = 0.0f;
     }
   }
+}
+
+// Makes @p set the active lookup. Acquisition thread only (or before it
+// starts): the set in use is never written.
+void conversion_install(const ConversionSet &set) {
+  ConversionSet *spare = (active_conversion == &conversion_sets[0])
+                             ? &conversion_sets[1]
+                             : &conversion_sets[0];
+  *spare = set;
+  active_conversion = spare;
+}
+
+// Raw value the active conversion maps closest to @p mm, by bisection over
+// the range it is known to be monotonic on (in either direction); clamped to
+// its ends. Not timed as STAGE_CONVERT, which covers the per-sample path.
+uint16_t raw_at_diameter(uint8_t sensor, float mm) {
+  const SensorConversion &c = active_conversion->sensor[sensor];
+  uint16_t lo = c.raw_lo, hi = c.raw_hi;
+  bool rising = conversion_eval(c, hi) >= conversion_eval(c, lo);
+  while (lo < hi) {
+    uint16_t mid = (uint16_t)((lo + hi) / 2);
+    if ((conversion_eval(c, mid) < mm) == rising)
+      lo = (uint16_t)(mid + 1);
+    else
+      hi = mid;
+  }
+  return lo;
+}
 
-  return diameter;
+// Restarts the drift estimators around the active conversion. Call from the
+// acquisition thread (or before it starts) whenever it changes.
+void drift_reset() {
+  for (uint8_t s = 0; s < 2; s++)
+    drift_trackers[s].set_reference(raw_at_diameter(s, DRIFT_NOMINAL_MM));
 }
 
 void measure_sensor_values(void) {
   uint16_t raw1 = read_sensor_raw_adc(0);
   uint16_t raw2 = read_sensor_raw_adc(1);
 
-  sensor1_mm = convert_raw_adc_to_mm(raw1, 0);
-  sensor2_mm = convert_raw_adc_to_mm(raw2, 1);
+  // The estimators see the uncorrected signal; calibration captures do not
+  // count as filament running through.
+  uint16_t conv1 = raw1;
+  uint16_t conv2 = raw2;
+  if (!calibration_active) {
+    drift_trackers[0].add(raw1);
+    drift_trackers[1].add(raw2);
+  }
+  if (drift_correction_enabled) {
+    conv1 = drift_trackers[0].correct(raw1);
+    conv2 = drift_trackers[1].correct(raw2);
+  }
+
+  sensor1_mm = convert_raw_adc_to_mm(conv1, 0);
+  sensor2_mm = convert_raw_adc_to_mm(conv2, 1);
+  sensor_raw[0] = raw1;
+  sensor_raw[1] = raw2;
+
+  push_ext_sample(raw1, raw2, sensor1_mm, sensor2_mm);
 }
 
 // ============================================================================
 // CALIBRATION
 // ============================================================================
 
-void calibration(void) {
-  printf("\n=== Calibration Started ===\n");
+// Calibration runs as a state machine on the acquisition thread next to the
+// normal acquisition cycle: the published frame keeps carrying live values
+// converted with the current tables, points are averaged from the live sample
+// stream, and the new tables replace the old ones in one step once all points
+// are in. Console output is handed to main_queue so it never delays sampling.
+
+#define CAL_POINTS 3
+
+enum CalState { CAL_IDLE, CAL_WAIT_NEXT, CAL_CAPTURE };
+
+struct CalSession {
+  CalState state;
+  bool single; // one host-requested point instead of a button session
+  bool fit;    // single capture for the fit set, not the table
+  uint8_t sensor;
+  uint8_t point;
+  float diameter_mm; // reference of the point being captured
+  StableCapture capture;
+  CalibrationPoint staged[2][CAL_POINTS];
+};
 
-  float diameters[] = {1.50f, 1.75f, 2.00f};
+static const float cal_diameters[CAL_POINTS] = {1.50f, 1.75f, 2.00f};
+static CalSession cal = {};
 
-  // Pre-fill buffer output to safe 1.75mm
-  sensor1_mm = 1.75f;
-  sensor2_mm = 1.75f;
-  format_sensor_data_fixed(mm_to_fixed_10000(1.75f), (uint8_t *)&tx_buffer[0]);
-  format_sensor_data_fixed(mm_to_fixed_10000(1.75f), (uint8_t *)&tx_buffer[5]);
+// Named calibration profiles (sensor heads, rod sets), persisted as one
+// record. calibration_tables and calibration_fits are the working copy of
+// the active profile; calibration_save() folds them back before writing.
+// The set is owned by main_queue, the active index and name by the
+// acquisition thread.
+#define CALIB_PROFILES 4
+#define CALIB_PROFILE_NAME_LEN 12
 
-  for (int s = 0; s < 2; s++) {
-    printf("Calibrating Sensor %d\n", s + 1);
-
-    for (int p = 0; p < 3; p++) {
-      printf("  S%d Point %d (%.2fmm) - Press NEXT button...\n", s + 1, p + 1,
-             diameters[p]);
-
-      // Wait for button press
-      while (cal_next_btn.read() == 1) {
-        ThisThread::sleep_for(10ms);
-        measure_sensor_values();
-      }
-      ThisThread::sleep_for(50ms);
-
-      // Capture calibration point
-      calibration_tables[s][p].raw_adc = read_sensor_raw_adc(s);
-      calibration_tables[s][p].diameter_mm = diameters[p];
-
-      printf("    Captured ADC: %u\n", calibration_tables[s][p].raw_adc);
-
-      // Wait for button release
-      while (cal_next_btn.read() == 0) {
-        ThisThread::sleep_for(10ms);
-      }
-      ThisThread::sleep_for(50ms);
+static_assert(EXT_CAL_PROFILES == CALIB_PROFILES, "calibration page layout");
+static_assert(EXT_CAL_PROFILE_NAME_LEN == CALIB_PROFILE_NAME_LEN,
+              "calibration page layout");
+
+struct CalibProfileName {
+  char s[CALIB_PROFILE_NAME_LEN]; // NUL-terminated
+};
+
+struct CalibProfile {
+  char name[CALIB_PROFILE_NAME_LEN]; // empty: slot unused
+  CalibrationPoint tables[2][CAL_POINTS];
+};
+
+struct CalibProfileSet {
+  uint8_t active;
+  uint8_t reserved[3];
+  CalibProfile profiles[CALIB_PROFILES];
+  CalibFitModel fits[CALIB_PROFILES][2];
+};
+
+// calib_flash.h quotes the saves per sector erase for this record size.
+static_assert(sizeof(CalibProfileSet) == 596, "update calib_flash.h");
+
+static CalibProfileSet calib_profiles = {};
+static volatile uint8_t calib_profile_active = 0;
+static char calib_profile_name[CALIB_PROFILE_NAME_LEN] = "default";
+static uint8_t calib_profile_used = 1; // bit per slot, for the calib page
+
+// Switch prepared on main_queue, applied on the acquisition thread. Only one
+// in flight; calibration commands are refused meanwhile.
+struct ProfileSwitch {
+  uint8_t profile;
+  char name[CALIB_PROFILE_NAME_LEN];
+  uint8_t used;
+  CalibrationPoint tables[2][CAL_POINTS];
+  CalibFitModel fits[2];
+  ConversionSet conversion;
+};
+
+static ProfileSwitch profile_switch;
+static volatile bool profile_switch_pending = false;
+
+// Host commands on the secondary address (see ext_frame.h). Parsed in the
+// I2C ISR, executed on the acquisition thread.
+static_assert(EXT_CAL_POINTS == CAL_POINTS, "calibration page layout");
+
+struct ExtCalCommand {
+  uint8_t cmd;
+  uint8_t sensor;
+  uint8_t point;
+  uint8_t profile;
+  uint8_t degree; // EXT_CMD_CAL_FIT_SOLVE
+  uint8_t apply;
+  uint16_t raw[CAL_POINTS];
+  uint16_t mm_x10000[CAL_POINTS];
+  CalibProfileName name; // EXT_CMD_CAL_PROFILE, empty: keep
+};
+
+static uint8_t cal_last_cmd = 0;
+static uint8_t cal_last_result = EXT_CAL_OK;
+static uint32_t cal_cmd_count = 0;
+
+// Outcome of the last point capture, for the calibration page.
+static uint32_t cal_last_settle = 0;
+static uint32_t cal_last_accepted = 0;
+static uint32_t cal_last_rejected = 0;
+
+// Least-squares fit sets, one per sensor (see calib_fit.h). Owned by the
+// acquisition thread; the fit page lists the set touched last.
+static_assert(EXT_FIT_MAX_POINTS == CALIB_FIT_MAX_POINTS, "fit page layout");
+static_assert(EXT_FIT_OK == CALIB_FIT_OK &&
+                  EXT_FIT_NOT_MONOTONIC == CALIB_FIT_NOT_MONOTONIC &&
+                  EXT_FIT_BAD_DEGREE == CALIB_FIT_BAD_DEGREE,
+              "fit page status codes");
+
+static CalibFitPoint fit_points[2][CALIB_FIT_MAX_POINTS];
+static uint8_t fit_count[2] = {0, 0};
+static CalibFitResult fit_result[2];
+static bool fit_solved[2] = {false, false}; // fit_result matches the set
+static uint8_t fit_sensor = 0;
+
+// Console side. The acquisition thread logs through the deferred log, so
+// none of these wait for the UART.
+static void cal_print_started() {
+  log_printf("\n=== Calibration Started ===\n");
+}
+
+static void cal_print_prompt(uint8_t sensor, uint8_t point) {
+  if (point == 0)
+    log_printf("Calibrating Sensor %d\n", sensor + 1);
+  log_printf("  S%d Point %d (%.2fmm) - Press NEXT button...\n", sensor + 1,
+             point + 1, cal_diameters[point]);
+}
+
+static void cal_print_captured(uint16_t raw_adc, float raw_var,
+                               uint32_t rejected) {
+  log_printf("    Captured ADC: %u (var %.2f, %lu outliers)\n", raw_adc,
+             raw_var, rejected);
+}
+
+static void cal_print_fit(uint8_t sensor, const CalibFitResult &r,
+                          bool applied) {
+  if (r.status != CALIB_FIT_OK) {
+    log_printf("Fit S%d: failed (status %u, %u points, degree %u)\n",
+               sensor + 1, r.status, r.count, r.degree);
+    return;
+  }
+  log_printf("Fit S%d: %u points, degree %u, rms %.1fum, max %.1fum, "
+             "R2 %.6f%s\n",
+             sensor + 1, r.count, r.degree, r.rms_mm * 1000.0f,
+             r.max_abs_mm * 1000.0f, r.r2, applied ? ", applied" : "");
+}
+
+static void cal_print_unstable() {
+  log_printf("    Signal not stable, press NEXT to retry\n");
+}
+
+static void cal_print_complete() {
+  log_printf("=== Calibration Complete ===\n\n");
+}
+
+// Runs on main_queue, which owns calib_profiles.
+static void cal_print_profile() {
+  uint8_t p = calib_profile_active;
+  printf("Calibration: profile %u '%s' active\n", p,
+         calib_profiles.profiles[p].name);
+}
+
+// Profile 0 from @p tables, the others unused, no fitted curves.
+static void calibration_default_profile(const CalibrationPoint (*tables)[3]) {
+  memset(&calib_profiles, 0, sizeof(calib_profiles));
+  strcpy(calib_profiles.profiles[0].name, "default");
+  memcpy(calib_profiles.profiles[0].tables, tables,
+         sizeof(calib_profiles.profiles[0].tables));
+}
+
+// Loads the newest stored tables; keeps the defaults if there are none.
+// Runs once at boot, before acquisition and the I2C slave start.
+void calibration_load() {
+  calib_flash_ok = calib_flash.init();
+  if (!calib_flash_ok) {
+    printf("Calibration: flash unavailable, using defaults\n");
+    return;
+  }
+  calib_store.mount();
+  if (calib_store.load(CALIB_FORMAT_PROFILES, &calib_profiles,
+                       sizeof(calib_profiles)) &&
+      calib_profiles.active < CALIB_PROFILES) {
+    printf("Calibration: loaded record #%lu\n",
+           (unsigned long)calib_store.seq());
+  } else {
+    calibration_default_profile(calibration_tables);
+    printf("Calibration: no stored record, using defaults\n");
+  }
+  // Nothing else runs yet, so this is the cheapest time for the erase.
+  if (calib_store.spare_dirty() && !calib_store.erase_spare())
+    printf("Calibration: spare sector erase failed\n");
+}
+
+void refresh_ext_diag();
+
+// Sector erases stall all code running from flash, the I2C slave included,
+// for up to ~2 s (see calib_flash.h). The pages announce it first.
+static void calib_flash_busy_begin() {
+  calib_flash_busy = true;
+  refresh_ext_diag();
+  ThisThread::sleep_for(std::chrono::milliseconds(CALIB_ERASE_ANNOUNCE_MS));
+}
+
+static void calib_flash_busy_end() {
+  calib_flash_busy = false;
+  refresh_ext_diag();
+}
+
+// Makes the profile stored in calib_profiles.active the working tables and
+// builds its lookup. Runs once at boot, after calibration_load().
+void calibration_activate_stored() {
+  if (calib_profiles.profiles[calib_profiles.active].name[0] == '\0')
+    calibration_default_profile(calibration_tables); // no flash
+  const CalibProfile &p = calib_profiles.profiles[calib_profiles.active];
+  memcpy(calibration_tables, p.tables, sizeof(calibration_tables));
+  memcpy(calibration_fits, calib_profiles.fits[calib_profiles.active],
+         sizeof(calibration_fits));
+  calib_profile_active = calib_profiles.active;
+  strcpy(calib_profile_name, p.name);
+  calib_profile_used = 0;
+  for (int i = 0; i < CALIB_PROFILES; i++)
+    if (calib_profiles.profiles[i].name[0] != '\0')
+      calib_profile_used |= (uint8_t)(1U << i);
+
+  ConversionSet set;
+  conversion_build(&set, calibration_tables, calibration_fits);
+  conversion_install(set);
+  cal_print_profile();
+}
+
+// Folds the active tables into their profile and persists all profiles.
+// Runs on main_queue; the copy is taken in a critical section so a table
+// swap on the acquisition thread can't tear it.
+void calibration_save() {
+  calib_save_requested = false;
+  core_util_critical_section_enter();
+  uint8_t active = calib_profile_active;
+  memcpy(calib_profiles.profiles[active].tables, calibration_tables,
+         sizeof(calibration_tables));
+  memcpy(calib_profiles.fits[active], calibration_fits,
+         sizeof(calibration_fits));
+  core_util_critical_section_exit();
+  calib_profiles.active = active;
+
+  if (!calib_flash_ok)
+    return;
+  // Normally the spare was erased while idle; otherwise erase inline.
+  bool erase = calib_store.save_erases(sizeof(calib_profiles));
+  if (erase)
+    calib_flash_busy_begin();
+  bool ok = calib_store.save(CALIB_FORMAT_PROFILES, &calib_profiles,
+                             sizeof(calib_profiles));
+  if (erase)
+    calib_flash_busy_end();
+  if (ok)
+    printf("Calibration: saved record #%lu\n",
+           (unsigned long)calib_store.seq());
+  else
+    printf("Calibration: save failed\n");
+  acq_queue.call(publish_ext_calib); // new store_seq
+}
+
+// Runs on main_queue.
+static void calibration_save_pending() {
+  if (calib_save_requested)
+    calibration_save();
+}
+
+// Erases the spare sector once the bus has been quiet for
+// CALIB_ERASE_IDLE_MS, so the next sector switch does not stall a host that
+// is polling. Runs on main_queue.
+static void calibration_erase_when_idle() {
+  static uint32_t last_traffic = 0;
+  static uint32_t quiet_ms = 0;
+  if (!calib_flash_ok || !calib_store.spare_dirty())
+    return;
+  I2CSlaveStats st;
+  i2c_slave_dma_get_stats(&st);
+  uint32_t traffic = st.reads + st.writes;
+  bool quiet = traffic == last_traffic && !calibration_active;
+  last_traffic = traffic;
+  quiet_ms = quiet ? quiet_ms + CALIB_HOUSEKEEPING_MS : 0;
+  if (quiet_ms < CALIB_ERASE_IDLE_MS)
+    return;
+
+  quiet_ms = 0;
+  calib_flash_busy_begin();
+  bool ok = calib_store.erase_spare();
+  calib_flash_busy_end();
+  printf("Calibration: spare sector %s\n", ok ? "erased" : "erase failed");
+}
+
+// Periodic on main_queue: picks up save requests whose post was dropped and
+// erases the spare sector when the bus is idle.
+void calibration_housekeeping() {
+  calibration_save_pending();
+  calibration_erase_when_idle();
+}
+
+// Asks main_queue to persist the working tables. Acquisition thread only;
+// if the queue is full, calibration_housekeeping() saves them later.
+static void calibration_request_save() {
+  calib_save_requested = true;
+  if (main_queue.call(calibration_save_pending) == 0)
+    log_printf("Calibration: queue full, save deferred\n");
+}
+
+static void calibration_apply_profile();
+
+// Runs on main_queue: stages the tables of the requested profile and builds
+// their lookup off the acquisition thread, then hands the result over.
+void calibration_prepare_profile(uint8_t profile, CalibProfileName name) {
+  CalibProfile &p = calib_profiles.profiles[profile];
+  if (p.name[0] == '\0') {
+    // Unused slot: start from the active tables.
+    core_util_critical_section_enter();
+    memcpy(p.tables, calibration_tables, sizeof(p.tables));
+    memcpy(calib_profiles.fits[profile], calibration_fits,
+           sizeof(calibration_fits));
+    core_util_critical_section_exit();
+    snprintf(p.name, sizeof(p.name), "profile%u", profile);
+  }
+  if (name.s[0] != '\0')
+    strcpy(p.name, name.s);
+
+  profile_switch.profile = profile;
+  strcpy(profile_switch.name, p.name);
+  profile_switch.used = 0;
+  for (int i = 0; i < CALIB_PROFILES; i++)
+    if (calib_profiles.profiles[i].name[0] != '\0')
+      profile_switch.used |= (uint8_t)(1U << i);
+  memcpy(profile_switch.tables, p.tables, sizeof(profile_switch.tables));
+  memcpy(profile_switch.fits, calib_profiles.fits[profile],
+         sizeof(profile_switch.fits));
+  conversion_build(&profile_switch.conversion, profile_switch.tables,
+                   profile_switch.fits);
+  if (acq_queue.call(calibration_apply_profile) == 0) {
+    profile_switch_pending = false; // accept commands again
+    printf("Calibration: profile switch dropped, queue full\n");
+  }
+}
+
+// Rebuilds the conversion from the working tables and curves and persists
+// them. Acquisition thread only.
+static void calibration_install() {
+  ConversionSet set;
+  conversion_build(&set, calibration_tables, calibration_fits);
+  conversion_install(set);
+  drift_reset(); // the new conversion already reflects the current offset
+  calibration_request_save();
+}
+
+// Makes cal.staged the active tables. Runs on the acquisition thread, so no
+// conversion sees a partial table. A sensor whose table changed drops its
+// fitted curve.
+static void calibration_commit() {
+  for (int s = 0; s < 2; s++)
+    if (memcmp(calibration_tables[s], cal.staged[s], sizeof(cal.staged[s])))
+      calibration_fits[s].degree = 0;
+  memcpy(calibration_tables, cal.staged, sizeof(calibration_tables));
+  calibration_install();
+}
+
+static bool calibration_idle() {
+  return cal.state == CAL_IDLE && !profile_switch_pending;
+}
+
+// Installs the switch prepared by calibration_prepare_profile(). Posted to
+// acq_queue; nothing else could start meanwhile (calibration_idle()).
+static void calibration_apply_profile() {
+  memcpy(calibration_tables, profile_switch.tables,
+         sizeof(calibration_tables));
+  memcpy(calibration_fits, profile_switch.fits, sizeof(calibration_fits));
+  conversion_install(profile_switch.conversion);
+  calib_profile_active = profile_switch.profile;
+  strcpy(calib_profile_name, profile_switch.name);
+  calib_profile_used = profile_switch.used;
+  drift_reset();
+  profile_switch_pending = false;
+
+  cal_last_result = EXT_CAL_OK;
+  publish_ext_calib();
+  calibration_request_save(); // persists the active index
+  main_queue.call(cal_print_profile); // console only
+}
+
+static void calibration_finish() {
+  calibration_commit();
+  cal.state = CAL_IDLE;
+  calibration_active = false;
+  if (cal.single)
+    cal_last_result = EXT_CAL_OK;
+  else
+    cal_print_complete();
+  publish_ext_calib();
+}
+
+// NEXT pressed: capture the point from the live samples once they are
+// stable (see stable_capture.h). Posted to acq_queue.
+void calibration_on_next() {
+  if (cal.state != CAL_WAIT_NEXT)
+    return;
+  cal.diameter_mm = cal_diameters[cal.point];
+  cal.capture.start();
+  cal.state = CAL_CAPTURE;
+  publish_ext_calib();
+}
+
+// Posted to acq_queue.
+void calibration_start() {
+  if (!calibration_idle())
+    return;
+  memcpy(cal.staged, calibration_tables, sizeof(cal.staged));
+  cal.single = false;
+  cal.fit = false;
+  cal.sensor = 0;
+  cal.point = 0;
+  cal.state = CAL_WAIT_NEXT;
+  calibration_active = true;
+  publish_ext_calib();
+
+  cal_print_started();
+  cal_print_prompt(cal.sensor, cal.point);
+}
+
+static void calibration_fit_append(uint8_t sensor, uint16_t raw, float mm) {
+  CalibFitPoint &pt = fit_points[sensor][fit_count[sensor]++];
+  pt.raw = raw;
+  pt.mm = mm;
+  fit_solved[sensor] = false;
+  fit_sensor = sensor;
+  publish_ext_fit();
+}
+
+// Called once per acquisition cycle with the fresh raw values.
+void calibration_on_sample(uint16_t raw1, uint16_t raw2) {
+  if (cal.state != CAL_CAPTURE)
+    return;
+
+  CaptureResult r = cal.capture.add((cal.sensor == 0) ? raw1 : raw2);
+  if (r == CAPTURE_RUNNING)
+    return;
+
+  cal_last_settle = cal.capture.settle_samples();
+  cal_last_accepted = cal.capture.accepted();
+  cal_last_rejected = cal.capture.rejected();
+  if (r == CAPTURE_UNSTABLE) {
+    if (cal.single) {
+      // Host capture: give up, tables unchanged.
+      cal.state = CAL_IDLE;
+      calibration_active = false;
+      cal_last_result = EXT_CAL_UNSTABLE;
+    } else {
+      cal.state = CAL_WAIT_NEXT;
+      cal_print_unstable();
     }
+    publish_ext_calib();
+    return;
   }
 
-  printf("=== Calibration Complete ===\n\n");
+  if (cal.fit) {
+    calibration_fit_append(cal.sensor, cal.capture.mean(), cal.diameter_mm);
+    cal_print_captured(cal.capture.mean(), cal.capture.variance(),
+                       cal.capture.rejected());
+    cal.state = CAL_IDLE;
+    calibration_active = false;
+    cal_last_result = EXT_CAL_OK;
+    publish_ext_calib();
+    return;
+  }
+
+  CalibrationPoint &pt = cal.staged[cal.sensor][cal.point];
+  pt.raw_adc = cal.capture.mean();
+  pt.diameter_mm = cal.diameter_mm;
+  pt.raw_var = cal.capture.variance();
+  cal_print_captured(pt.raw_adc, pt.raw_var, cal.capture.rejected());
+
+  if (cal.single) {
+    calibration_finish();
+    return;
+  }
+  if (++cal.point == CAL_POINTS) {
+    cal.point = 0;
+    if (++cal.sensor == 2) {
+      calibration_finish();
+      return;
+    }
+  }
+  cal.state = CAL_WAIT_NEXT;
+  publish_ext_calib();
+  cal_print_prompt(cal.sensor, cal.point);
+}
+
+static uint8_t calibration_write_table(const ExtCalCommand &c) {
+  if (!calibration_idle())
+    return EXT_CAL_BUSY;
+  if (c.sensor >= 2)
+    return EXT_CAL_BAD_ARGS;
+  for (int p = 0; p < CAL_POINTS; p++) {
+    if (c.mm_x10000[p] == 0 || (p > 0 && c.raw[p] <= c.raw[p - 1]))
+      return EXT_CAL_BAD_ARGS;
+  }
+
+  memcpy(cal.staged, calibration_tables, sizeof(cal.staged));
+  for (int p = 0; p < CAL_POINTS; p++) {
+    cal.staged[c.sensor][p].raw_adc = c.raw[p];
+    cal.staged[c.sensor][p].diameter_mm =
+        (float)c.mm_x10000[p] / (float)SENSOR_MM_FIXED_SCALE;
+    cal.staged[c.sensor][p].raw_var = 0.0f;
+  }
+  calibration_commit();
+  return EXT_CAL_OK;
+}
+
+static uint8_t calibration_capture_point(const ExtCalCommand &c) {
+  if (!calibration_idle())
+    return EXT_CAL_BUSY;
+  if (c.sensor >= 2 || c.point >= CAL_POINTS || c.mm_x10000[0] == 0)
+    return EXT_CAL_BAD_ARGS;
+
+  memcpy(cal.staged, calibration_tables, sizeof(cal.staged));
+  cal.single = true;
+  cal.fit = false;
+  cal.sensor = c.sensor;
+  cal.point = c.point;
+  cal.diameter_mm = (float)c.mm_x10000[0] / (float)SENSOR_MM_FIXED_SCALE;
+  cal.capture.start();
+  cal.state = CAL_CAPTURE;
+  calibration_active = true;
+  return EXT_CAL_PENDING;
+}
+
+static uint8_t calibration_fit_add(const ExtCalCommand &c) {
+  if (!calibration_idle())
+    return EXT_CAL_BUSY;
+  if (c.sensor >= 2 || c.mm_x10000[0] == 0 ||
+      fit_count[c.sensor] >= CALIB_FIT_MAX_POINTS)
+    return EXT_CAL_BAD_ARGS;
+
+  float mm = (float)c.mm_x10000[0] / (float)SENSOR_MM_FIXED_SCALE;
+  if (c.raw[0] != EXT_CAL_RAW_CAPTURE) {
+    calibration_fit_append(c.sensor, c.raw[0], mm);
+    return EXT_CAL_OK;
+  }
+  cal.single = true;
+  cal.fit = true;
+  cal.sensor = c.sensor;
+  cal.diameter_mm = mm;
+  cal.capture.start();
+  cal.state = CAL_CAPTURE;
+  calibration_active = true;
+  return EXT_CAL_PENDING;
+}
+
+// Fixed work for at most CALIB_FIT_MAX_POINTS points, so it runs inline
+// between two acquisition cycles.
+static uint8_t calibration_fit_solve(const ExtCalCommand &c) {
+  if (!calibration_idle())
+    return EXT_CAL_BUSY;
+  if (c.sensor >= 2)
+    return EXT_CAL_BAD_ARGS;
+
+  uint8_t s = c.sensor;
+  CalibFitResult &r = fit_result[s];
+  calib_fit(fit_points[s], fit_count[s], c.degree, &r);
+  fit_solved[s] = true;
+  fit_sensor = s;
+  bool ok = r.status == CALIB_FIT_OK;
+  if (ok && c.apply) {
+    CalibFitModel &m = calibration_fits[s];
+    m.degree = r.degree;
+    m.count = r.count;
+    m.raw_min = r.raw_min;
+    m.raw_max = r.raw_max;
+    m.center = r.center;
+    memcpy(m.coeff, r.coeff, sizeof(m.coeff));
+    m.rms_mm = r.rms_mm;
+    m.r2 = r.r2;
+    calibration_install();
+  }
+  publish_ext_fit();
+
+  cal_print_fit(s, r, ok && c.apply != 0);
+  return ok ? EXT_CAL_OK : EXT_CAL_FIT_FAILED;
+}
+
+static uint8_t calibration_fit_clear(const ExtCalCommand &c) {
+  if (!calibration_idle())
+    return EXT_CAL_BUSY;
+  if (c.sensor >= 2)
+    return EXT_CAL_BAD_ARGS;
+  fit_count[c.sensor] = 0;
+  fit_solved[c.sensor] = false;
+  fit_sensor = c.sensor;
+  publish_ext_fit();
+  return EXT_CAL_OK;
+}
+
+static uint8_t calibration_select_profile(const ExtCalCommand &c) {
+  if (!calibration_idle())
+    return EXT_CAL_BUSY;
+  if (c.profile >= CALIB_PROFILES)
+    return EXT_CAL_BAD_ARGS;
+  profile_switch_pending = true;
+  if (main_queue.call(calibration_prepare_profile, c.profile, c.name) == 0) {
+    profile_switch_pending = false;
+    return EXT_CAL_BUSY;
+  }
+  return EXT_CAL_PENDING;
+}
+
+// Posted to acq_queue from the I2C write sink.
+void calibration_on_command(ExtCalCommand c) {
+  cal_cmd_count++;
+  cal_last_cmd = c.cmd;
+  if (c.cmd == EXT_CMD_CAL_WRITE)
+    cal_last_result = calibration_write_table(c);
+  else if (c.cmd == EXT_CMD_CAL_PROFILE)
+    cal_last_result = calibration_select_profile(c);
+  else if (c.cmd == EXT_CMD_CAL_FIT_ADD)
+    cal_last_result = calibration_fit_add(c);
+  else if (c.cmd == EXT_CMD_CAL_FIT_SOLVE)
+    cal_last_result = calibration_fit_solve(c);
+  else if (c.cmd == EXT_CMD_CAL_FIT_CLEAR)
+    cal_last_result = calibration_fit_clear(c);
+  else
+    cal_last_result = calibration_capture_point(c);
+  publish_ext_calib();
 }
 
 // ============================================================================
@@ -223,6 +1080,7 @@ uint32_t mm_to_fixed_10000(float val) {
 }
 
 void format_sensor_data_fixed(uint32_t val_x10000, uint8_t *buf) {
+  StageTimer timer(STAGE_FORMAT);
   if (val_x10000 > SENSOR_MM_FIXED_MAX)
     val_x10000 = SENSOR_MM_FIXED_MAX;
 
@@ -233,64 +1091,712 @@ void format_sensor_data_fixed(uint32_t val_x10000, uint8_t *buf) {
   buf[4] = val_x10000 % 10U;
 }
 
+// Formats both diameters into the writer slot and publishes it. Lock-free:
+// never masks interrupts and never waits for a read in progress.
+void publish_sensor_frame(float mm1, float mm2) {
+  uint8_t *buf = tx_frames.write_buffer();
+  format_sensor_data_fixed(mm_to_fixed_10000(mm1), buf);
+  format_sensor_data_fixed(mm_to_fixed_10000(mm2), buf + 5);
+
+  StageTimer timer(STAGE_PUBLISH);
+  tx_frames.publish();
+  // Pre-load byte 0 of the new frame so the next read needs no stretching.
+  i2c_slave_dma_restage();
+}
+
+// ----------------------------------------------------------------------------
+// Extended stream pages (secondary address)
+// ----------------------------------------------------------------------------
+
+uint16_t mm_to_u16_x10000(float mm) {
+  uint32_t v = mm_to_fixed_10000(mm);
+  return (uint16_t)(v > 0xFFFFU ? 0xFFFFU : v);
+}
+
+static uint16_t ext_status_bits() {
+  uint16_t status = 0;
+#if TEST_MODE
+  status |= EXT_STATUS_TEST_MODE;
+#endif
+  if (calibration_active)
+    status |= EXT_STATUS_CALIBRATING;
+  if (i2c_slave_dma_recovering())
+    status |= EXT_STATUS_I2C_RECOVERING;
+  if (calib_flash_busy)
+    status |= EXT_STATUS_FLASH_BUSY;
+  return status;
+}
+
+// Appends one acquisition cycle to the FIFO and republishes the stream page
+// with the newest EXT_FIFO_DEPTH samples, oldest first.
+void push_ext_sample(uint16_t raw1, uint16_t raw2, float mm1, float mm2) {
+  uint32_t seq = ++acq_cycle_count;
+
+  ExtSample &smp = ext_history[ext_history_head];
+  smp.seq = seq;
+  smp.t_us = (uint32_t)get_uptime_us();
+  smp.raw[0] = raw1;
+  smp.raw[1] = raw2;
+  smp.mm_x10000[0] = mm_to_u16_x10000(mm1);
+  smp.mm_x10000[1] = mm_to_u16_x10000(mm2);
+  ext_history_head = (ext_history_head + 1) % EXT_FIFO_DEPTH;
+  if (ext_history_count < EXT_FIFO_DEPTH)
+    ext_history_count++;
+
+  publish_ext_stream();
+  telemetry_push_sample(seq, smp.t_us, raw1, raw2, mm1, mm2,
+                        ext_status_bits());
+}
+
+void publish_ext_stream() {
+  StageTimer timer(STAGE_EXT_PAGE);
+  ExtStreamPage *page = (ExtStreamPage *)ext_stream_frames.write_buffer();
+  memset(page, 0, sizeof(*page));
+  page->status = ext_status_bits();
+  page->count = ext_history_count;
+  uint8_t idx =
+      (ext_history_head + EXT_FIFO_DEPTH - ext_history_count) % EXT_FIFO_DEPTH;
+  for (uint8_t i = 0; i < ext_history_count; i++) {
+    page->samples[i] = ext_history[idx];
+    idx = (idx + 1) % EXT_FIFO_DEPTH;
+  }
+  ext_seal(page, EXT_PAGE_STREAM);
+  ext_stream_frames.publish();
+}
+
+void publish_ext_diag() {
+  I2CSlaveStats st;
+  i2c_slave_dma_get_stats(&st);
+
+  ExtDiagPage *page = (ExtDiagPage *)ext_diag_frames.write_buffer();
+  memset(page, 0, sizeof(*page));
+  page->uptime_ms = (uint32_t)(get_uptime_us() / 1000U);
+  page->acq_cycles = acq_cycle_count;
+  page->frames_published = tx_frames.published_count();
+  page->i2c_reads = st.reads;
+  page->i2c_writes = st.writes;
+  page->i2c_partial_reads = st.partial_reads;
+  page->i2c_bus_errors = st.bus_errors;
+  page->i2c_arb_lost = st.arb_lost;
+  page->i2c_overruns = st.overruns;
+  page->i2c_timeouts = st.timeouts;
+  page->i2c_sda_stuck = st.sda_stuck;
+  page->i2c_scl_stuck = st.scl_stuck;
+  page->i2c_recoveries = st.recoveries;
+  page->i2c_staged_reads = st.staged_reads;
+  page->i2c_unstaged_reads = st.unstaged_reads;
+  page->i2c_tx_underruns = st.tx_underruns;
+  page->i2c_stretch_ns_min = st.stretch_ns_min;
+  page->i2c_stretch_ns_max = st.stretch_ns_max;
+  page->i2c_stretch_ns_mean = st.stretch_ns_mean;
+  page->acq_latency_ns_min = acq_latency_ns_min;
+  page->acq_latency_ns_max = acq_latency_ns_max;
+  page->acq_latency_ns_mean = acq_latency_ns_mean();
+  page->acq_ticks_missed = acq_ticks_missed;
+  page->i2c_irqs = st.irqs;
+
+#if defined(MBED_CPU_STATS_ENABLED)
+  // Tickless idle: the core sits in WFI between acquisition ticks and I2C
+  // interrupts. Totals since boot; rates are left to the host.
+  mbed_stats_cpu_t cpu;
+  mbed_stats_cpu_get(&cpu);
+  page->cpu_idle_ms = (uint32_t)(cpu.idle_time / 1000U);
+  page->cpu_sleep_ms = (uint32_t)(cpu.sleep_time / 1000U);
+  page->cpu_deep_sleep_ms = (uint32_t)(cpu.deep_sleep_time / 1000U);
+#endif
+  page->acq_busy_ms = busy_ms(&acq_busy_cycles);
+  page->i2c_busy_ms = busy_ms(&i2c_busy_cycles);
+  CpuLoadReport load[2];
+  get_cpu_load(&load[0], &load[1]);
+  ExtCpuLoad *ext_load[2] = {&page->load_1s, &page->load_10s};
+  for (int w = 0; w < 2; w++) {
+    ExtCpuLoad *e = ext_load[w];
+    e->window_ms =
+        (uint16_t)(load[w].window_ms > 0xFFFFU ? 0xFFFFU : load[w].window_ms);
+    e->busy_permille = load[w].busy_permille;
+    e->thread_permille[EXT_LOAD_ACQ] = load[w].thread_permille[EXT_LOAD_ACQ];
+    e->thread_permille[EXT_LOAD_I2C] = load[w].thread_permille[EXT_LOAD_I2C];
+    e->other_permille = load[w].other_permille;
+  }
+  PeriodSnapshot period;
+  get_acq_period(&period);
+  page->acq_period_dev_ns_max = period.dev_ns_max;
+
+  page->drift_offset[0] = drift_trackers[0].offset();
+  page->drift_offset[1] = drift_trackers[1].offset();
+  page->drift_flags = (drift_correction_enabled ? EXT_DRIFT_ENABLED : 0) |
+                      (drift_trackers[0].settled() ? EXT_DRIFT_SETTLED_S1 : 0) |
+                      (drift_trackers[1].settled() ? EXT_DRIFT_SETTLED_S2 : 0);
+
+  const SupervisorRecord &prev = supervisor_previous();
+  page->reset_reason = prev.reset_reason;
+  page->prev_missed_mask = prev.missed_mask;
+  page->boot_count = prev.valid ? (uint16_t)(prev.boot_count + 1U) : 1U;
+  page->prev_uptime_ms = prev.uptime_ms;
+
+  for (uint8_t i = 0; i < EXT_THREAD_COUNT; i++) {
+    uint16_t used, size;
+    get_stack_usage(thread_id(i), &used, &size);
+    page->stack_used[i] = used;
+    page->stack_size[i] = size;
+  }
+  page->log_dropped = deferred_log_dropped();
+  strncpy(page->fw_version, FW_VERSION, sizeof(page->fw_version));
+  ext_seal(page, EXT_PAGE_DIAG);
+  ext_diag_frames.publish();
+}
+
+// Written from the acquisition thread only (owner of the tables).
+void publish_ext_calib() {
+  ExtCalibPage *page = (ExtCalibPage *)ext_calib_frames.write_buffer();
+  memset(page, 0, sizeof(*page));
+  page->cal_state = cal.state == CAL_WAIT_NEXT ? EXT_CAL_STATE_WAIT_NEXT
+                    : cal.state == CAL_CAPTURE ? EXT_CAL_STATE_CAPTURE
+                                               : EXT_CAL_STATE_IDLE;
+  page->last_cmd = cal_last_cmd;
+  page->last_result = cal_last_result;
+  page->profile = calib_profile_active;
+  page->profile_used = calib_profile_used;
+  memcpy(page->profile_name, calib_profile_name, sizeof(page->profile_name));
+  page->fit_degree[0] = calibration_fits[0].degree;
+  page->fit_degree[1] = calibration_fits[1].degree;
+  page->cmd_count = cal_cmd_count;
+  page->store_seq = calib_store.seq();
+  page->capture_settle = cal_last_settle;
+  page->capture_accepted = cal_last_accepted;
+  page->capture_rejected = cal_last_rejected;
+  for (int s = 0; s < 2; s++) {
+    for (int p = 0; p < CAL_POINTS; p++) {
+      const CalibrationPoint &pt = calibration_tables[s][p];
+      float var_x100 = pt.raw_var * 100.0f + 0.5f;
+      page->points[s][p].raw = pt.raw_adc;
+      page->points[s][p].mm_x10000 = mm_to_u16_x10000(pt.diameter_mm);
+      page->points[s][p].raw_var_x100 =
+          var_x100 > 65535.0f ? 0xFFFFU : (uint16_t)var_x100;
+    }
+  }
+  ext_seal(page, EXT_PAGE_CALIB);
+  ext_calib_frames.publish();
+}
+
+static inline int16_t mm_to_i16_x10000(float mm) {
+  float v = mm * (float)SENSOR_MM_FIXED_SCALE;
+  v += v < 0.0f ? -0.5f : 0.5f;
+  return (int16_t)(v > 32767.0f ? 32767 : v < -32768.0f ? -32768 : v);
+}
+
+static inline uint32_t mm_to_nm(float mm) {
+  float v = mm * 1e6f + 0.5f;
+  return v > 4294967295.0f ? 0xFFFFFFFFU : (uint32_t)v;
+}
+
+// Written from the acquisition thread only (owner of the fit sets).
+void publish_ext_fit() {
+  uint8_t s = fit_sensor;
+  const CalibFitResult &r = fit_result[s];
+  bool ok = fit_solved[s] && r.status == CALIB_FIT_OK;
+
+  ExtFitPage *page = (ExtFitPage *)ext_fit_frames.write_buffer();
+  memset(page, 0, sizeof(*page));
+  page->sensor = s;
+  page->count = fit_count[s];
+  page->status = fit_solved[s] ? r.status : EXT_FIT_NONE;
+  page->degree = fit_solved[s] ? r.degree : 0;
+  if (ok) {
+    page->center = r.center;
+    memcpy(page->coeff, r.coeff, sizeof(page->coeff));
+    page->rms_nm = mm_to_nm(r.rms_mm);
+    page->max_abs_nm = mm_to_nm(r.max_abs_mm);
+    page->r2_ppm = r.r2 > 0.0f ? (uint32_t)(r.r2 * 1e6f + 0.5f) : 0;
+  }
+  for (uint8_t i = 0; i < fit_count[s]; i++) {
+    page->points[i].raw = fit_points[s][i].raw;
+    page->points[i].mm_x10000 = mm_to_u16_x10000(fit_points[s][i].mm);
+    page->points[i].residual_x10000 =
+        ok ? mm_to_i16_x10000(r.residual[i]) : 0;
+  }
+  ext_seal(page, EXT_PAGE_FIT);
+  ext_fit_frames.publish();
+}
+
+void publish_ext_timing() {
+  PeriodSnapshot period;
+  get_acq_period(&period);
+
+  ExtTimingPage *page = (ExtTimingPage *)ext_timing_frames.write_buffer();
+  memset(page, 0, sizeof(*page));
+  page->nominal_ns = acq_period.nominal_ns();
+  page->count = period.count;
+  page->min_ns = period.min_ns;
+  page->max_ns = period.max_ns;
+  page->mean_ns = period.mean_ns;
+  page->dev_ns_max = period.dev_ns_max;
+  page->hist_lower_ns = PeriodStats::bin_lower_ns(0);
+  page->hist_bin_ns = PERIOD_HIST_BIN_NS;
+  memcpy(page->hist, period.hist, sizeof(page->hist));
+  page->core_hz = SystemCoreClock;
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    StageSnapshot st;
+    stage_profile_get(i, &st);
+    page->stages[i].count = st.count;
+    page->stages[i].min_cycles = st.min_cycles;
+    page->stages[i].max_cycles = st.max_cycles;
+    page->stages[i].mean_cycles = st.mean_cycles;
+  }
+  ext_seal(page, EXT_PAGE_TIMING);
+  ext_timing_frames.publish();
+}
+
+// Every EXT_DIAG_REFRESH_MS on main_queue, the only writer of both pages.
+void refresh_ext_diag() {
+  publish_ext_diag();
+  publish_ext_timing();
+}
+
+// EXT_THREAD_* index -> RTOS thread id (null before the thread started).
+osThreadId_t thread_id(uint8_t ext_thread) {
+  switch (ext_thread) {
+  case EXT_THREAD_MAIN:
+    return main_thread_id;
+  case EXT_THREAD_ACQ:
+    return acq_thread.get_id();
+  case EXT_THREAD_I2C:
+    return i2c_thread.get_id();
+  case EXT_THREAD_LED:
+    return led_thread.get_id();
+  case EXT_THREAD_LOG:
+    return log_thread.get_id();
+  default:
+    return nullptr;
+  }
+}
+
+// Peak stack use of a thread, from the RTX fill pattern (watermark).
+void get_stack_usage(osThreadId_t id, uint16_t *used, uint16_t *size) {
+  *used = 0;
+  *size = 0;
+  if (id == nullptr)
+    return;
+  uint32_t total = osThreadGetStackSize(id);
+  *size = (uint16_t)total;
+  *used = (uint16_t)(total - osThreadGetStackSpace(id));
+}
+
+uint32_t busy_ms(const uint64_t *cycles) {
+  core_util_critical_section_enter();
+  uint64_t c = *cycles;
+  core_util_critical_section_exit();
+  return (uint32_t)(c / (SystemCoreClock / 1000U));
+}
+
+uint64_t busy_us(const uint64_t *cycles) {
+  core_util_critical_section_enter();
+  uint64_t c = *cycles;
+  core_util_critical_section_exit();
+  return c / (SystemCoreClock / 1000000U);
+}
+
+void get_cpu_load(CpuLoadReport *load_1s, CpuLoadReport *load_10s) {
+  core_util_critical_section_enter();
+  *load_1s = cpu_load_1s;
+  *load_10s = cpu_load_10s;
+  core_util_critical_section_exit();
+}
+
 uint64_t get_uptime_us() {
   // Timer::elapsed_time() reports microseconds on mbed chrono durations.
   return (uint64_t)uptime_timer.elapsed_time().count();
 }
 
+#if TEST_MODE
+static uint8_t test_payload[TX_FRAME_LEN];
+#endif
+
+// Runs in the I2C1 event ISR on every ReadAddressed; the returned buffer is
+// streamed out by DMA.
+const uint8_t *i2c_frame_source(uint8_t addr_index, uint16_t *len) {
+  if (addr_index == I2C_SLAVE_ADDR_SECONDARY) {
+    // Extended stream: the page the host selected last.
+    if (ext_page == EXT_PAGE_DIAG) {
+      *len = sizeof(ExtDiagPage);
+      return ext_diag_frames.acquire();
+    }
+    if (ext_page == EXT_PAGE_TIMING) {
+      *len = sizeof(ExtTimingPage);
+      return ext_timing_frames.acquire();
+    }
+    if (ext_page == EXT_PAGE_CALIB) {
+      *len = sizeof(ExtCalibPage);
+      return ext_calib_frames.acquire();
+    }
+    if (ext_page == EXT_PAGE_FIT) {
+      *len = sizeof(ExtFitPage);
+      return ext_fit_frames.acquire();
+    }
+    *len = sizeof(ExtStreamPage);
+    return ext_stream_frames.acquire();
+  }
+
+  *len = TX_FRAME_LEN;
+
+#if TEST_MODE
+  // In test mode, serve the fixed test payload on each read.
+  return test_payload;
+#else
+  // Latch the newest published frame; it stays stable for the whole DMA
+  // transfer because the writer never touches the reader's slot.
+  return tx_frames.acquire();
+#endif
+}
+
+static inline uint16_t le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Runs in the I2C1 event ISR when a host write ends.
+void i2c_write_sink(uint8_t addr_index, const uint8_t *data, uint16_t len) {
+  if (addr_index != I2C_SLAVE_ADDR_SECONDARY || len == 0) {
+    // Host write probes on the legacy address are drained and ignored.
+    return;
+  }
+  if (data[0] < EXT_PAGE_COUNT) {
+    ext_page = data[0];
+    return;
+  }
+
+  ExtCalCommand c = {};
+  c.cmd = data[0];
+  if (c.cmd == EXT_CMD_CAL_WRITE && len >= 2 + CAL_POINTS * 4) {
+    c.sensor = data[1];
+    for (int p = 0; p < CAL_POINTS; p++) {
+      c.raw[p] = le16(&data[2 + p * 4]);
+      c.mm_x10000[p] = le16(&data[4 + p * 4]);
+    }
+  } else if (c.cmd == EXT_CMD_CAL_CAPTURE && len >= 5) {
+    c.sensor = data[1];
+    c.point = data[2];
+    c.mm_x10000[0] = le16(&data[3]);
+  } else if (c.cmd == EXT_CMD_CAL_FIT_ADD && len >= 6) {
+    c.sensor = data[1];
+    c.raw[0] = le16(&data[2]);
+    c.mm_x10000[0] = le16(&data[4]);
+  } else if (c.cmd == EXT_CMD_CAL_FIT_SOLVE && len >= 4) {
+    c.sensor = data[1];
+    c.degree = data[2];
+    c.apply = data[3];
+  } else if (c.cmd == EXT_CMD_CAL_FIT_CLEAR && len >= 2) {
+    c.sensor = data[1];
+  } else if (c.cmd == EXT_CMD_CAL_PROFILE && len >= 2) {
+    c.profile = data[1];
+    for (uint16_t i = 0; i + 2 < len && i < CALIB_PROFILE_NAME_LEN - 1; i++) {
+      char ch = (char)data[2 + i];
+      if (ch == '\0')
+        break;
+      c.name.s[i] = (ch >= ' ' && ch <= '~') ? ch : '_';
+    }
+  } else {
+    return; // unknown or truncated
+  }
+  acq_queue.call(calibration_on_command, c);
+}
+
 void reinit_i2c_slave() {
-  i2c_slave.stop();
-  // mbed reinitializes the peripheral in frequency(); set address afterwards.
-  i2c_slave.frequency(SENSOR_I2C_FREQUENCY_HZ);
-  i2c_slave.address(SENSOR_I2C_ADDRESS);
+  i2c_slave_dma_init(SENSOR_I2C_ADDRESS, SENSOR_I2C_ADDRESS_EXT,
+                     SENSOR_I2C_FREQUENCY_HZ, i2c_frame_source,
+                     i2c_write_sink);
 }
 
 // ============================================================================
 // I2C SLAVE THREAD
 // ============================================================================
 
+// Called from the I2C service thread: logged, never waits for the UART.
+void print_i2c_slave_stats(const I2CSlaveStats &st) {
+  log_printf("I2C: reads=%lu writes=%lu partial=%lu pad=%lu\n", st.reads,
+             st.writes, st.partial_reads, st.tx_pad_bytes);
+  log_printf("I2C: berr=%lu arlo=%lu ovr=%lu timeout=%lu sda_stuck=%lu "
+             "scl_stuck=%lu\n",
+             st.bus_errors, st.arb_lost, st.overruns, st.timeouts,
+             st.sda_stuck, st.scl_stuck);
+  log_printf("I2C: recoveries=%lu bus_clears=%lu max_recovery=%lums\n",
+             st.recoveries, st.bus_clears, st.recovery_ms_max);
+#if I2C_SLAVE_NOSTRETCH
+  // No stretching to time; what costs a byte is a read that found nothing
+  // staged, or DMA missing a slot.
+  uint32_t per_1k =
+      st.reads ? (uint32_t)((uint64_t)st.tx_underruns * 1000U / st.reads) : 0;
+  log_printf("I2C: staged=%lu unstaged=%lu underruns=%lu (%lu per 1k reads)\n",
+             st.staged_reads, st.unstaged_reads, st.tx_underruns, per_1k);
+#else
+  log_printf("I2C: staged=%lu unstaged=%lu underruns=%lu "
+             "stretch min/mean/max=%lu/%lu/%luns\n",
+             st.staged_reads, st.unstaged_reads, st.tx_underruns,
+             st.stretch_ns_min, st.stretch_ns_mean, st.stretch_ns_max);
+#endif
+}
+
+#define I2C_CHECK_IN_MAX_MS 100 // < SUPERVISOR_I2C_DEADLINE_MS
+
 void i2c_slave_thread() {
-  while (true) {
-    int status = i2c_slave.receive();
+  // Transfers are served entirely from the I2C/DMA interrupts; this thread
+  // only runs the fault detection / bus recovery steps. It never touches the
+  // acquisition path, so a hung bus cannot stall measurement. The diag and
+  // timing pages are built on main_queue (refresh_ext_diag()), below
+  // acquisition.
+  uint32_t wait_ms = I2C_SLAVE_SERVICE_PERIOD_MS;
+  uint32_t recoveries_seen = 0;
 
-    if (status == I2CSlave::NoData) {
-      // Yield CPU while idle without adding latency to addressed transactions.
-      ThisThread::sleep_for(1ms);
-      continue;
+  while (true) {
+    i2c_slave_dma_wait_for(I2C_SLAVE_EVT_ERROR, wait_ms);
+    uint32_t start = cycle_counter_now();
+    supervisor_check_in(SUPERVISOR_CH_I2C);
+    wait_ms = i2c_slave_dma_service();
+    // Long backoff steps are cut short to keep checking in with the
+    // supervisor.
+    if (wait_ms > I2C_CHECK_IN_MAX_MS)
+      wait_ms = I2C_CHECK_IN_MAX_MS;
+
+    I2CSlaveStats st;
+    i2c_slave_dma_get_stats(&st);
+    if (st.recoveries != recoveries_seen) {
+      recoveries_seen = st.recoveries;
+      log_printf("I2C: slave recovered\n");
+      print_i2c_slave_stats(st);
     }
 
-    if (status == I2CSlave::WriteGeneral) {
-      // General-call writes are ignored (best-effort drain for compatibility).
-      char dummy;
-      (void)i2c_slave.read(&dummy, 1);
-    } else if (status == I2CSlave::WriteAddressed) {
-      // Host write probes are treated as non-fatal (best-effort drain).
-      char dummy;
-      (void)i2c_slave.read(&dummy, 1);
-    } else if (status == I2CSlave::ReadAddressed) {
-      // Primary path: respond with the latest 10-byte diameter payload.
-      i2c_request_count++;
-      last_i2c_request_time_us = get_uptime_us();
-
-      // In test mode, serve fixed test payload directly on each read.
-#if TEST_MODE
-      uint8_t test_payload[10];
-      format_sensor_data_fixed(TEST_SENSOR1_X10000, test_payload);
-      format_sensor_data_fixed(TEST_SENSOR2_X10000, test_payload + 5);
-      if (i2c_slave.write((const char *)test_payload, 10) != 0) {
+    uint32_t busy = cycle_counter_now() - start;
+    core_util_critical_section_enter();
+    i2c_busy_cycles += busy;
+    core_util_critical_section_exit();
+  }
+}
+
+// ============================================================================
+// ACQUISITION THREAD (dispatched from acq_queue)
+// ============================================================================
+
+void on_acquisition_complete(uint32_t start_cycles) {
+  // Publish lock-free; a read in flight keeps its own slot.
+  publish_sensor_frame(sensor1_mm, sensor2_mm);
+
+  uint32_t now = cycle_counter_now();
+  uint32_t ns = cycles_to_ns(now - acq_tick_cycles);
+  core_util_critical_section_enter();
+  if (acq_latency_samples == 0 || ns < acq_latency_ns_min)
+    acq_latency_ns_min = ns;
+  if (ns > acq_latency_ns_max)
+    acq_latency_ns_max = ns;
+  acq_latency_ns_sum += ns;
+  acq_latency_samples++;
+  acq_busy_cycles += now - start_cycles;
+  core_util_critical_section_exit();
+  acq_pending = false;
+}
+
+// Start-to-start period of the acquisition cycle as seen by this thread;
+// timer jitter and anything scheduled above it show up here.
+static void record_acq_period(uint32_t start_cycles) {
+  if (acq_period_started) {
+    uint32_t ns = cycles_to_ns(start_cycles - acq_last_start_cycles);
+    core_util_critical_section_enter();
+    acq_period.add(ns);
+    core_util_critical_section_exit();
+  }
+  acq_last_start_cycles = start_cycles;
+  acq_period_started = true;
+}
+
+void get_acq_period(PeriodSnapshot *out) {
+  core_util_critical_section_enter();
+  acq_period.snapshot(out);
+  core_util_critical_section_exit();
+}
+
+void acquisition_event() {
+  uint32_t start = cycle_counter_now();
+  record_acq_period(start);
+  supervisor_check_in(SUPERVISOR_CH_ACQ);
+
+  measure_sensor_values();
+  calibration_on_sample(sensor_raw[0], sensor_raw[1]);
+  on_acquisition_complete(start);
+}
+
+// Ticker ISR: one acquisition per period. A tick that finds the previous
+// cycle still queued is counted instead of piling up events.
+void on_acq_tick() {
+  if (acq_pending) {
+    acq_ticks_missed++;
+    return;
+  }
+  acq_pending = true;
+  acq_tick_cycles = cycle_counter_now();
+  acq_queue.call(acquisition_event);
+}
+
+uint32_t acq_latency_ns_mean() {
+  core_util_critical_section_enter();
+  uint32_t mean = acq_latency_samples
+                      ? (uint32_t)(acq_latency_ns_sum / acq_latency_samples)
+                      : 0;
+  core_util_critical_section_exit();
+  return mean;
+}
+
+// ============================================================================
+// MAIN CONTROL EVENTS (dispatched from main_queue)
+// ============================================================================
+
+// Every CPU_LOAD_SAMPLE_MS. Idle time is what mbed's idle loop accounts
+// (the RTOS idle hook, including sleep); the acquisition and I2C threads
+// are timed with the cycle counter around their work.
+void cpu_load_sample() {
+  CpuLoadSample s;
+  s.t_us = get_uptime_us();
+  s.thread_us[EXT_LOAD_ACQ] = busy_us(&acq_busy_cycles);
+  s.thread_us[EXT_LOAD_I2C] = busy_us(&i2c_busy_cycles);
+#if defined(MBED_CPU_STATS_ENABLED)
+  mbed_stats_cpu_t cpu;
+  mbed_stats_cpu_get(&cpu);
+  s.idle_us = cpu.idle_time;
 #else
-      // Buffer is continuously refreshed by main loop; no copy/allocation here.
-      if (i2c_slave.write((const char *)tx_buffer, 10) != 0) {
+  // Without idle accounting only the timed threads count as busy.
+  s.idle_us = s.t_us - s.thread_us[EXT_LOAD_ACQ] - s.thread_us[EXT_LOAD_I2C];
 #endif
-        printf("I2C: read-response write failed, reinitializing slave\n");
-        reinit_i2c_slave();
-        continue;
-      }
-    }
+  cpu_load.add(s);
+
+  CpuLoadReport load_1s = cpu_load.window(1000 / CPU_LOAD_SAMPLE_MS);
+  CpuLoadReport load_10s = cpu_load.window(10000 / CPU_LOAD_SAMPLE_MS);
+  core_util_critical_section_enter();
+  cpu_load_1s = load_1s;
+  cpu_load_10s = load_10s;
+  core_util_critical_section_exit();
+}
 
-    // Keep bus service latency low while cooperating with other threads.
-    ThisThread::yield();
+static void print_load_window(const char *name, const CpuLoadReport &r) {
+  const uint16_t v[4] = {r.busy_permille, r.thread_permille[EXT_LOAD_ACQ],
+                         r.thread_permille[EXT_LOAD_I2C], r.other_permille};
+  printf("Load %s: busy=%u.%u%% acq=%u.%u%% i2c=%u.%u%% other=%u.%u%%\n",
+         name, v[0] / 10U, v[0] % 10U, v[1] / 10U, v[1] % 10U, v[2] / 10U,
+         v[2] % 10U, v[3] / 10U, v[3] % 10U);
+}
+
+// CPU utilization over the last 1 s and 10 s.
+void print_thread_load() {
+  CpuLoadReport load_1s, load_10s;
+  get_cpu_load(&load_1s, &load_10s);
+  if (load_1s.window_ms == 0)
+    return;
+  print_load_window("1s", load_1s);
+  print_load_window("10s", load_10s);
+}
+
+void print_acq_period() {
+  PeriodSnapshot p;
+  get_acq_period(&p);
+  printf("Period: n=%lu min/mean/max=%lu/%lu/%luns dev_max=%luns "
+         "missed=%lu\n",
+         (unsigned long)p.count, (unsigned long)p.min_ns,
+         (unsigned long)p.mean_ns, (unsigned long)p.max_ns,
+         (unsigned long)p.dev_ns_max, (unsigned long)acq_ticks_missed);
+  // Bins of PERIOD_HIST_BIN_NS deviation from nominal; the outer bins are
+  // open-ended.
+  printf("Jitter[%ldns +%dns]:", (long)PeriodStats::bin_lower_ns(0),
+         PERIOD_HIST_BIN_NS);
+  for (int i = 0; i < PERIOD_HIST_BINS; i++)
+    printf(" %lu", (unsigned long)p.hist[i]);
+  printf("\n");
+}
+
+void print_stage_profile() {
+  printf("Stages (cycles min/mean/max):");
+  for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+    StageSnapshot st;
+    stage_profile_get(i, &st);
+    printf(" %s=%lu/%lu/%lu", stage_profile_name(i),
+           (unsigned long)st.min_cycles, (unsigned long)st.mean_cycles,
+           (unsigned long)st.max_cycles);
+  }
+  printf("\n");
+}
+
+void print_reset_record() {
+  const SupervisorRecord &r = supervisor_previous();
+  printf("Reset: %s", supervisor_reset_name(r.reset_reason));
+  if (r.valid) {
+    printf(" boot=%u after %lums missed=0x%02X age acq/i2c=%u/%ums",
+           (unsigned)r.boot_count + 1U, (unsigned long)r.uptime_ms,
+           r.missed_mask, r.age_ms[SUPERVISOR_CH_ACQ],
+           r.age_ms[SUPERVISOR_CH_I2C]);
+  }
+  printf("\n");
+}
+
+void print_stack_usage() {
+  static const char *const names[EXT_THREAD_COUNT] = {"main", "acq", "i2c",
+                                                       "led", "log"};
+  printf("Stack:");
+  for (uint8_t i = 0; i < EXT_THREAD_COUNT; i++) {
+    uint16_t used, size;
+    get_stack_usage(thread_id(i), &used, &size);
+    printf(" %s=%u/%u", names[i], used, size);
   }
+  printf("\n");
+}
+
+void print_drift() {
+  printf("Drift: s1=%d%s s2=%d%s correction=%s\n",
+         drift_trackers[0].offset(),
+         drift_trackers[0].settled() ? "" : "(learning)",
+         drift_trackers[1].offset(),
+         drift_trackers[1].settled() ? "" : "(learning)",
+         drift_correction_enabled ? "on" : "off");
+}
+
+void print_telemetry() {
+  TelemetryStats t;
+  telemetry_get_stats(&t);
+  if (!t.active)
+    return;
+  printf("Telemetry: baud=%lu sent=%lu dropped=%lu text_dropped=%lu\n",
+         (unsigned long)t.baud, (unsigned long)t.samples_sent,
+         (unsigned long)t.samples_dropped, (unsigned long)t.text_dropped);
+}
+
+void print_periodic_stats() {
+  print_thread_load();
+  print_acq_period();
+  print_stage_profile();
+  print_stack_usage();
+  print_drift();
+  print_telemetry();
+}
+
+// Buttons are active low. Each edge interrupt arms at most one settle
+// timer; the debounced press is acted on from the queue.
+static bool cal_start_held() { return cal_start_btn.read() == 0; }
+static bool cal_next_held() { return cal_next_btn.read() == 0; }
+
+void settle_cal_start() {
+  if (cal_start_debounce.on_settled(cal_start_held) == BUTTON_PRESSED)
+    acq_queue.call(calibration_start);
+}
+
+void settle_cal_next() {
+  if (cal_next_debounce.on_settled(cal_next_held) == BUTTON_PRESSED)
+    acq_queue.call(calibration_on_next);
+}
+
+void on_cal_start_edge() {
+  if (cal_start_debounce.on_edge())
+    main_queue.call_in(std::chrono::milliseconds(BUTTON_DEBOUNCE_MS),
+                       settle_cal_start);
+}
+
+void on_cal_next_edge() {
+  if (cal_next_debounce.on_edge())
+    main_queue.call_in(std::chrono::milliseconds(BUTTON_DEBOUNCE_MS),
+                       settle_cal_next);
 }
 
 // ============================================================================
@@ -307,6 +1813,293 @@ void led_heartbeat_thread() {
   }
 }
 
+// ============================================================================
+// SERIAL SHELL (polled by the log thread, see shell.h)
+// ============================================================================
+
+// Commands only read shared state or hand the work to the thread that owns
+// it: reports to main_queue, calibration to acq_queue. Settings are not
+// persisted; a reset restores the build defaults.
+
+static volatile uint32_t stats_period_ms = STATS_PRINT_PERIOD_MS;
+static int stats_event_id = 0;
+
+// Runs on main_queue; 0 stops the periodic report.
+static void schedule_periodic_stats(uint32_t period_ms) {
+  if (stats_event_id != 0)
+    main_queue.cancel(stats_event_id);
+  stats_event_id = 0;
+  stats_period_ms = period_ms;
+  if (period_ms != 0)
+    stats_event_id = main_queue.call_every(
+        std::chrono::milliseconds(period_ms), print_periodic_stats);
+}
+
+static void print_shell_stats() {
+  print_periodic_stats();
+  I2CSlaveStats st;
+  i2c_slave_dma_get_stats(&st);
+  print_i2c_slave_stats(st);
+  printf("Console: rx_dropped=%lu log_dropped=%lu\n",
+         (unsigned long)serial_port_rx_dropped(),
+         (unsigned long)deferred_log_dropped());
+}
+
+struct ShellSetting {
+  const char *name;
+  const char *help;
+  uint32_t (*get)();
+  bool (*set)(uint32_t value); // false: value out of range
+};
+
+static uint32_t get_drift_correction() {
+  return drift_correction_enabled ? 1U : 0U;
+}
+
+static bool set_drift_correction(uint32_t value) {
+  if (value > 1U)
+    return false;
+  drift_correction_enabled = value != 0;
+  return true;
+}
+
+static uint32_t get_stats_period() { return stats_period_ms; }
+
+static bool set_stats_period(uint32_t value) {
+  if (value != 0 && value < 100U)
+    return false;
+  main_queue.call(schedule_periodic_stats, value);
+  return true;
+}
+
+static const ShellSetting shell_settings[] = {
+    {"drift_correction", "0/1, apply the drift estimate (masks steady "
+                         "deviations up to ~0.047mm)",
+     get_drift_correction, set_drift_correction},
+    {"stats_period_ms", "periodic report, 0 = off, >= 100",
+     get_stats_period, set_stats_period},
+};
+
+static const ShellSetting *find_setting(const char *name) {
+  for (const ShellSetting &s : shell_settings)
+    if (strcmp(s.name, name) == 0)
+      return &s;
+  printf("unknown setting '%s'\n", name);
+  return nullptr;
+}
+
+// Console copy of the working calibration: taken on the acquisition
+// thread, which owns it, and printed on main_queue.
+struct CalibrationDump {
+  uint8_t profile;
+  bool session_open;
+  CalibProfileName name;
+  CalibrationPoint tables[2][CAL_POINTS];
+  CalibFitModel fits[2];
+};
+
+static void cal_print_dump(CalibrationDump d) {
+  printf("Calibration: profile %u '%s'%s\n", d.profile, d.name.s,
+         d.session_open ? ", session open" : "");
+  for (int s = 0; s < 2; s++) {
+    const CalibrationPoint *t = d.tables[s];
+    printf("  S%d table: %u=%.4fmm %u=%.4fmm %u=%.4fmm\n", s + 1,
+           t[0].raw_adc, t[0].diameter_mm, t[1].raw_adc, t[1].diameter_mm,
+           t[2].raw_adc, t[2].diameter_mm);
+    const CalibFitModel &f = d.fits[s];
+    if (f.degree == 0)
+      printf("  S%d fit: none, table in use\n", s + 1);
+    else
+      printf("  S%d fit: degree %u of %u points, center %.1f, "
+             "c %.5f %.4e %.4e, rms %.1fum\n",
+             s + 1, f.degree, f.count, f.center, f.coeff[0], f.coeff[1],
+             f.coeff[2], f.rms_mm * 1000.0f);
+  }
+}
+
+// Posted to acq_queue.
+static void calibration_dump() {
+  CalibrationDump d;
+  d.profile = calib_profile_active;
+  d.session_open = calibration_active;
+  strcpy(d.name.s, calib_profile_name);
+  memcpy(d.tables, calibration_tables, sizeof(d.tables));
+  memcpy(d.fits, calibration_fits, sizeof(d.fits));
+  if (main_queue.call(cal_print_dump, d) == 0)
+    log_printf("Calibration: queue full, dump dropped\n");
+}
+
+// Acquisition thread: the same path as an I2C command, plus a console line
+// when it is refused.
+static void calibration_on_shell_command(ExtCalCommand c) {
+  calibration_on_command(c);
+  if (cal_last_result != EXT_CAL_OK && cal_last_result != EXT_CAL_PENDING)
+    log_printf("Calibration: command 0x%02X refused (result %u)\n", c.cmd,
+               cal_last_result);
+}
+
+// Runs on main_queue, which owns calib_profiles.
+static void cal_print_profiles() {
+  for (uint8_t i = 0; i < CALIB_PROFILES; i++) {
+    const char *name = calib_profiles.profiles[i].name;
+    if (name[0] != '\0')
+      printf("  %u: %s%s\n", i, name,
+             i == calib_profile_active ? " (active)" : "");
+  }
+}
+
+static void cmd_stats(int argc, char **argv) {
+  main_queue.call(print_shell_stats);
+}
+
+static void cmd_config(int argc, char **argv) {
+  if (argc == 1) {
+    for (const ShellSetting &s : shell_settings)
+      printf("  %s = %lu  (%s)\n", s.name, (unsigned long)s.get(), s.help);
+    return;
+  }
+  if (argc == 3 && strcmp(argv[1], "get") == 0) {
+    const ShellSetting *s = find_setting(argv[2]);
+    if (s)
+      printf("%s = %lu\n", s->name, (unsigned long)s->get());
+    return;
+  }
+  if (argc == 4 && strcmp(argv[1], "set") == 0) {
+    const ShellSetting *s = find_setting(argv[2]);
+    if (!s)
+      return;
+    char *end;
+    unsigned long value = strtoul(argv[3], &end, 0);
+    if (*end != '\0' || !s->set((uint32_t)value))
+      printf("invalid value for %s\n", s->name);
+    else
+      printf("%s = %lu\n", s->name, value);
+    return;
+  }
+  printf("usage: config [get <name> | set <name> <value>]\n");
+}
+
+static void cmd_cal(int argc, char **argv) {
+  if (argc == 1 || (argc == 2 && strcmp(argv[1], "dump") == 0)) {
+    acq_queue.call(calibration_dump);
+    return;
+  }
+  if (argc == 2 && strcmp(argv[1], "profiles") == 0) {
+    main_queue.call(cal_print_profiles);
+    return;
+  }
+  if ((argc == 3 || argc == 4) && strcmp(argv[1], "profile") == 0) {
+    char *end;
+    unsigned long profile = strtoul(argv[2], &end, 10);
+    if (*end != '\0' || profile >= CALIB_PROFILES) {
+      printf("profile 0..%d\n", CALIB_PROFILES - 1);
+      return;
+    }
+    ExtCalCommand c = {};
+    c.cmd = EXT_CMD_CAL_PROFILE;
+    c.profile = (uint8_t)profile;
+    if (argc == 4)
+      strncpy(c.name.s, argv[3], sizeof(c.name.s) - 1);
+    acq_queue.call(calibration_on_shell_command, c);
+    return;
+  }
+  printf("usage: cal [dump | profiles | profile <n> [name]]\n");
+}
+
+static void cmd_stream(int argc, char **argv) {
+  if (argc == 2 && strcmp(argv[1], "start") == 0) {
+    telemetry_start(ACQ_PERIOD_US);
+  } else if (argc == 2 && strcmp(argv[1], "stop") == 0) {
+    telemetry_stop();
+  } else if (argc == 1) {
+    TelemetryStats t;
+    telemetry_get_stats(&t);
+    printf("Telemetry: %s, %lu baud, sent=%lu dropped=%lu\n",
+           t.active ? "streaming" : "off", (unsigned long)t.baud,
+           (unsigned long)t.samples_sent, (unsigned long)t.samples_dropped);
+  } else {
+    printf("usage: stream [start | stop]\n");
+  }
+}
+
+static void cmd_reboot(int argc, char **argv) {
+  printf("Rebooting\n");
+  serial_port_flush(500);
+  system_reset();
+}
+
+static const ShellCommand shell_commands[] = {
+    {"stats", "", "load, timing, stacks, drift, I2C", cmd_stats},
+    {"config", "[get|set <name> [value]]", "runtime settings", cmd_config},
+    {"cal", "[dump|profiles|profile n]", "calibration state, profiles",
+     cmd_cal},
+    {"stream", "[start|stop]", "binary telemetry on this port", cmd_stream},
+    {"reboot", "", "software reset", cmd_reboot},
+};
+
+// ============================================================================
+// LOG THREAD (deferred console output and shell, see deferred_log.h)
+// ============================================================================
+
+#if I2C_DEBUG_ENABLE
+// Prints the events recorded by the slave driver, with the time since the
+// previous event. Recording never waits for this; a slow console only costs
+// lost events.
+static void print_i2c_trace() {
+  static I2CTraceEvent batch[16];
+  static uint32_t last_cycles = 0;
+  static bool have_last = false;
+  static uint32_t lost_reported = 0;
+  static uint32_t lost = 0;
+
+  uint32_t n;
+  while ((n = i2c_trace_drain(batch, 16, &lost)) > 0) {
+    for (uint32_t i = 0; i < n; i++) {
+      const I2CTraceEvent &e = batch[i];
+      uint32_t dt_ns = have_last ? cycles_to_ns(e.cycles - last_cycles) : 0;
+      last_cycles = e.cycles;
+      have_last = true;
+      printf("I2CDBG +%luus %s a=0x%02X b=%u\n",
+             (unsigned long)(dt_ns / 1000U), i2c_trace_name(e.type), e.a,
+             e.b);
+    }
+  }
+  if (lost != lost_reported) {
+    printf("I2CDBG lost %lu events\n", (unsigned long)(lost - lost_reported));
+    lost_reported = lost;
+  }
+}
+#endif
+
+// Lowest priority of all threads: formats and prints what the other threads
+// logged, serves the shell, plus the I2C trace in the debug build.
+void log_drain_thread() {
+  uint32_t dropped_reported = 0;
+#if I2C_DEBUG_ENABLE
+  uint64_t next_trace_us = 0;
+#endif
+
+  while (true) {
+    ThisThread::sleep_for(std::chrono::milliseconds(LOG_DRAIN_PERIOD_MS));
+    while (deferred_log_drain(8) > 0) {
+    }
+    uint32_t dropped = deferred_log_dropped();
+    if (dropped != dropped_reported) {
+      printf("Log: %lu messages dropped\n",
+             (unsigned long)(dropped - dropped_reported));
+      dropped_reported = dropped;
+    }
+    shell_poll();
+#if I2C_DEBUG_ENABLE
+    uint64_t now_us = get_uptime_us();
+    if (now_us >= next_trace_us) {
+      print_i2c_trace();
+      next_trace_us = now_us + I2C_DEBUG_PRINT_PERIOD_MS * 1000ULL;
+    }
+#endif
+  }
+}
+
 // ============================================================================
 // MAIN FUNCTION
 // ============================================================================
@@ -314,32 +2107,39 @@ void led_heartbeat_thread() {
 int main() {
   // LED on during init
   led = 1;
+  cycle_counter_init();
+  supervisor_init();
+  main_thread_id = ThisThread::get_id();
 
   printf("\n=== STM32 Sensor (mbed OS) ===\n");
   printf("FW: %s\n", FW_VERSION);
+  print_reset_record();
   printf("I/O: 3.3V (matches Prusa MK4)\n");
   printf("I2C: 400kHz Fast Mode\n");
   printf("Address7: 0x%02X\n", SENSOR_I2C_ADDRESS >> 1);
   printf("Address8: 0x%02X\n", SENSOR_I2C_ADDRESS);
+  printf("Ext address7: 0x%02X\n", SENSOR_I2C_ADDRESS_EXT >> 1);
+
+  calibration_load();
+  calibration_activate_stored();
+  drift_reset();
 
 #if TEST_MODE
   sensor1_mm = TEST_SENSOR1_MM;
   sensor2_mm = TEST_SENSOR2_MM;
+  format_sensor_data_fixed(TEST_SENSOR1_X10000, test_payload);
+  format_sensor_data_fixed(TEST_SENSOR2_X10000, test_payload + 5);
   printf("TEST_MODE active: direct fixed I2C payload (%.4f, %.4f)\n",
          TEST_SENSOR1_MM, TEST_SENSOR2_MM);
 #else
   // Pre-fill I2C buffer with safe data FIRST
   sensor1_mm = 1.75f;
   sensor2_mm = 1.75f;
-  format_sensor_data_fixed(mm_to_fixed_10000(1.75f), (uint8_t *)&tx_buffer[0]);
-  format_sensor_data_fixed(mm_to_fixed_10000(1.75f), (uint8_t *)&tx_buffer[5]);
+  publish_sensor_frame(1.75f, 1.75f);
 
   // Initial measurement with real ADC data
   measure_sensor_values();
-  format_sensor_data_fixed(mm_to_fixed_10000(sensor1_mm),
-                           (uint8_t *)&tx_buffer[0]);
-  format_sensor_data_fixed(mm_to_fixed_10000(sensor2_mm),
-                           (uint8_t *)&tx_buffer[5]);
+  publish_sensor_frame(sensor1_mm, sensor2_mm);
 #endif
 
   // Start timers
@@ -350,51 +2150,62 @@ int main() {
 
   // Bring up the slave after payload initialization to avoid serving stale
   // bytes.
+  publish_ext_stream();
+  publish_ext_diag();
+  publish_ext_timing();
+  publish_ext_calib();
+  publish_ext_fit();
   reinit_i2c_slave();
 
   // Start I2C slave thread - data is already prepared
-  Thread i2c_thread(osPriorityRealtime);
   i2c_thread.start(i2c_slave_thread);
   printf("I2C thread started\n");
 
+  // Acquisition runs above control and logging; only the I2C recovery
+  // service is higher.
+  acq_thread.start(callback(&acq_queue, &EventQueue::dispatch_forever));
+  printf("Acquisition thread started\n");
+
   // Start independent LED heartbeat thread
-  Thread led_thread(osPriorityNormal);
   led_thread.start(led_heartbeat_thread);
   printf("LED thread starting...\n");
 
+  shell_init(shell_commands,
+             sizeof(shell_commands) / sizeof(shell_commands[0]));
+  log_thread.start(log_drain_thread);
+#if I2C_DEBUG_ENABLE
+  printf("I2C trace: %d events, printed every %dms\n",
+         I2C_DEBUG_EVENT_QUEUE_LEN, I2C_DEBUG_PRINT_PERIOD_MS);
+#endif
+
   // Small delay to let threads initialize
   ThisThread::sleep_for(200ms);
 
-  printf("Ready!\n");
-
-  while (true) {
-    // Check for calibration button
-    if (cal_start_btn.read() == 0) {
-      ThisThread::sleep_for(50ms); // Debounce
-      if (cal_start_btn.read() == 0) {
-        calibration();
-        // Wait for button release
-        while (cal_start_btn.read() == 0) {
-          ThisThread::sleep_for(10ms);
-        }
-        ThisThread::sleep_for(50ms);
-      }
-    }
+  printf("Ready! Type help for shell commands.\n");
 
-    // Update sensor measurements and I2C buffer
+  // From here on this thread only handles control: button events,
+  // calibration console output and periodic reports.
+  cal_start_btn.fall(on_cal_start_edge);
+  cal_start_btn.rise(on_cal_start_edge);
+  cal_next_btn.fall(on_cal_next_edge);
+  cal_next_btn.rise(on_cal_next_edge);
 #if !TEST_MODE
-    measure_sensor_values();
-
-    // Update I2C buffer atomically
-    uint8_t temp_buf[10];
-    format_sensor_data_fixed(mm_to_fixed_10000(sensor1_mm), temp_buf);
-    format_sensor_data_fixed(mm_to_fixed_10000(sensor2_mm), temp_buf + 5);
-
-    __disable_irq();
-    memcpy((void *)tx_buffer, temp_buf, 10);
-    __enable_irq();
+  acq_ticker.attach(on_acq_tick, std::chrono::microseconds(ACQ_PERIOD_US));
+  supervisor_start(1UL << SUPERVISOR_CH_ACQ | 1UL << SUPERVISOR_CH_I2C);
+#else
+  supervisor_start(1UL << SUPERVISOR_CH_I2C);
 #endif
-
-    ThisThread::sleep_for(2ms);
-  }
+#if TELEMETRY_AUTOSTART
+  telemetry_start(ACQ_PERIOD_US);
+#endif
+  cpu_load_sample();
+  main_queue.call_every(std::chrono::milliseconds(CPU_LOAD_SAMPLE_MS),
+                        cpu_load_sample);
+  main_queue.call_every(std::chrono::milliseconds(EXT_DIAG_REFRESH_MS),
+                        refresh_ext_diag);
+  main_queue.call_every(std::chrono::milliseconds(CALIB_HOUSEKEEPING_MS),
+                        calibration_housekeeping);
+  schedule_periodic_stats(STATS_PRINT_PERIOD_MS);
+
+  main_queue.dispatch_forever();
 }
@@ -0,0 +1,316 @@
+/**
+ * @file serial_port.cpp
+ * @brief Register-level USART2 console with DMA transmit (STM32F446)
+ *
+ * TX ring: head and tail count bytes since boot; writers advance head in a
+ * critical section, the DMA interrupt advances tail by the length of the
+ * transfer that just finished and starts the next one. A transfer never
+ * wraps, so a full ring takes at most two transfers.
+ *
+ * RX ring: the USART2 interrupt stores every received byte (RXNE) and is
+ * the only writer of rx_head; serial_port_read() is the only writer of
+ * rx_tail.
+ */
+
+#include "serial_port.h"
+
+#include "PeripheralPins.h"
+#include "mbed.h"
+#include "pinmap.h"
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+#define SERIAL_PORT_TX_PIN PA_2
+#define SERIAL_PORT_RX_PIN PA_3
+
+// DMA1 Stream 6, Channel 4 = USART2_TX (RM0390 Table 28).
+#define SERIAL_TX_DMA_STREAM DMA1_Stream6
+#define SERIAL_TX_DMA_CHANNEL 4U
+#define SERIAL_TX_DMA_CLEAR_FLAGS                                              \
+  (DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 |                    \
+   DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6)
+
+static_assert((SERIAL_TX_RING_SIZE & (SERIAL_TX_RING_SIZE - 1)) == 0,
+              "SERIAL_TX_RING_SIZE must be a power of two");
+static_assert((SERIAL_RX_RING_SIZE & (SERIAL_RX_RING_SIZE - 1)) == 0,
+              "SERIAL_RX_RING_SIZE must be a power of two");
+
+#define TX_MASK (SERIAL_TX_RING_SIZE - 1U)
+#define RX_MASK (SERIAL_RX_RING_SIZE - 1U)
+
+// ============================================================================
+// STATE
+// ============================================================================
+
+static uint8_t tx_ring[SERIAL_TX_RING_SIZE];
+static volatile uint32_t tx_head = 0; // bytes queued
+static volatile uint32_t tx_tail = 0; // bytes sent or in the running transfer
+static volatile uint32_t dma_len = 0; // running transfer, 0 while idle
+static volatile bool deep_sleep_locked = false;
+static uint8_t rx_ring[SERIAL_RX_RING_SIZE];
+static volatile uint32_t rx_head = 0; // bytes received
+static volatile uint32_t rx_tail = 0; // bytes read
+static volatile uint32_t rx_dropped = 0;
+static serial_console_sink_t volatile console_sink = nullptr;
+static bool initialized = false;
+static uint32_t current_baud = 0;
+
+// ============================================================================
+// TRANSMIT
+// ============================================================================
+
+// Starts the next transfer if the stream is idle. Critical section or ISR.
+static void tx_dma_kick() {
+  if (dma_len != 0)
+    return;
+  uint32_t pending = tx_head - tx_tail;
+  if (pending == 0) {
+    if (deep_sleep_locked) {
+      sleep_manager_unlock_deep_sleep();
+      deep_sleep_locked = false;
+    }
+    return;
+  }
+  if (!deep_sleep_locked) {
+    sleep_manager_lock_deep_sleep();
+    deep_sleep_locked = true;
+  }
+
+  uint32_t offset = tx_tail & TX_MASK;
+  uint32_t n = SERIAL_TX_RING_SIZE - offset;
+  if (n > pending)
+    n = pending;
+  dma_len = n;
+  DMA1->HIFCR = SERIAL_TX_DMA_CLEAR_FLAGS;
+  SERIAL_TX_DMA_STREAM->M0AR = (uint32_t)&tx_ring[offset];
+  SERIAL_TX_DMA_STREAM->NDTR = n;
+  SERIAL_TX_DMA_STREAM->CR |= DMA_SxCR_EN;
+}
+
+static void tx_dma_isr() {
+  uint32_t flags = DMA1->HISR;
+  DMA1->HIFCR = SERIAL_TX_DMA_CLEAR_FLAGS;
+  if (!(flags & (DMA_HISR_TCIF6 | DMA_HISR_TEIF6)))
+    return;
+  // A transfer error drops the chunk; the stream keeps going.
+  tx_tail = tx_tail + dma_len;
+  dma_len = 0;
+  tx_dma_kick();
+}
+
+size_t serial_port_write(const void *data, size_t len, bool all) {
+  if (len > SERIAL_WRITE_CHUNK)
+    len = all ? 0 : SERIAL_WRITE_CHUNK;
+  const uint8_t *src = (const uint8_t *)data;
+
+  core_util_critical_section_enter();
+  uint32_t space = SERIAL_TX_RING_SIZE - (tx_head - tx_tail);
+  if (len > space)
+    len = all ? 0 : space;
+  uint32_t head = tx_head;
+  for (size_t i = 0; i < len; i++)
+    tx_ring[(head + i) & TX_MASK] = src[i];
+  tx_head = head + len;
+  tx_dma_kick();
+  core_util_critical_section_exit();
+  return len;
+}
+
+bool serial_port_flush(uint32_t timeout_ms) {
+  for (uint32_t waited = 0;; waited++) {
+    if (tx_head == tx_tail && (USART2->SR & USART_SR_TC))
+      return true;
+    if (waited >= timeout_ms)
+      return false;
+    ThisThread::sleep_for(1ms);
+  }
+}
+
+// Fatal error output with interrupts off: finish by polling. The running
+// transfer is stopped where it is and the rest of the ring goes out first.
+static void write_polled(const uint8_t *data, size_t len) {
+  if (dma_len != 0) {
+    SERIAL_TX_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+    while (SERIAL_TX_DMA_STREAM->CR & DMA_SxCR_EN) {
+    }
+    tx_tail = tx_tail + (dma_len - SERIAL_TX_DMA_STREAM->NDTR);
+    dma_len = 0;
+  }
+  while (tx_tail != tx_head) {
+    while (!(USART2->SR & USART_SR_TXE)) {
+    }
+    USART2->DR = tx_ring[tx_tail & TX_MASK];
+    tx_tail = tx_tail + 1U;
+  }
+  for (size_t i = 0; i < len; i++) {
+    while (!(USART2->SR & USART_SR_TXE)) {
+    }
+    USART2->DR = data[i];
+  }
+  while (!(USART2->SR & USART_SR_TC)) {
+  }
+}
+
+// ============================================================================
+// RECEIVE
+// ============================================================================
+
+static void usart2_isr() {
+  uint32_t sr = USART2->SR;
+  if (!(sr & (USART_SR_RXNE | USART_SR_ORE)))
+    return;
+  // Reading DR after SR clears RXNE and the error flags.
+  uint8_t byte = (uint8_t)USART2->DR;
+  if (sr & USART_SR_ORE)
+    rx_dropped++; // at least one byte lost before this one
+  if (sr & (USART_SR_FE | USART_SR_NE))
+    return; // framing / noise: not a byte worth keeping
+  if (rx_head - rx_tail >= SERIAL_RX_RING_SIZE) {
+    rx_dropped++;
+    return;
+  }
+  rx_ring[rx_head & RX_MASK] = byte;
+  rx_head = rx_head + 1U;
+}
+
+size_t serial_port_read(void *data, size_t max) {
+  uint8_t *dst = (uint8_t *)data;
+  size_t n = 0;
+  while (n < max && rx_tail != rx_head) {
+    dst[n++] = rx_ring[rx_tail & RX_MASK];
+    rx_tail = rx_tail + 1U;
+  }
+  return n;
+}
+
+uint32_t serial_port_rx_dropped() { return rx_dropped; }
+
+// ============================================================================
+// SETUP
+// ============================================================================
+
+// BRR for @p baud. With either oversampling BRR read as one number is
+// PCLK1 / baud in units of the sampling clock, so the divider is rounded
+// once; OVER8 only extends the range to PCLK1 / 8.
+static void apply_baud(uint32_t baud) {
+  uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+  uint32_t div = (pclk1 + baud / 2U) / baud;
+  uint32_t cr1 =
+      USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_RXNEIE;
+  uint32_t brr;
+  if (div >= 16U) {
+    brr = div;
+  } else {
+    if (div < 8U)
+      div = 8U;
+    cr1 |= USART_CR1_OVER8;
+    brr = ((div >> 3) << 4) | (div & 7U);
+  }
+  USART2->CR1 = 0;
+  USART2->BRR = brr;
+  USART2->CR1 = cr1;
+  current_baud = pclk1 / div;
+}
+
+void serial_port_init(uint32_t baud) {
+  if (initialized)
+    return;
+  initialized = true;
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_USART2_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  pinmap_pinout(SERIAL_PORT_TX_PIN, PinMap_UART_TX);
+  pinmap_pinout(SERIAL_PORT_RX_PIN, PinMap_UART_RX);
+  pin_mode(SERIAL_PORT_RX_PIN, PullUp);
+
+  SERIAL_TX_DMA_STREAM->CR = 0;
+  while (SERIAL_TX_DMA_STREAM->CR & DMA_SxCR_EN) {
+  }
+  SERIAL_TX_DMA_STREAM->PAR = (uint32_t)&USART2->DR;
+  SERIAL_TX_DMA_STREAM->CR = (SERIAL_TX_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos) |
+                             DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_TCIE |
+                             DMA_SxCR_TEIE;
+  SERIAL_TX_DMA_STREAM->FCR = 0; // direct mode, byte-wide peripheral
+  DMA1->HIFCR = SERIAL_TX_DMA_CLEAR_FLAGS;
+
+  apply_baud(baud);
+  USART2->CR3 = USART_CR3_DMAT;
+
+  NVIC_SetVector(DMA1_Stream6_IRQn, (uint32_t)&tx_dma_isr);
+  NVIC_SetVector(USART2_IRQn, (uint32_t)&usart2_isr);
+  NVIC_ClearPendingIRQ(DMA1_Stream6_IRQn);
+  NVIC_ClearPendingIRQ(USART2_IRQn);
+  NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+  NVIC_EnableIRQ(USART2_IRQn);
+}
+
+uint32_t serial_port_set_baud(uint32_t baud) {
+  serial_port_flush(1000);
+  core_util_critical_section_enter();
+  apply_baud(baud);
+  core_util_critical_section_exit();
+  return current_baud;
+}
+
+uint32_t serial_port_baud() { return current_baud; }
+
+void serial_port_set_console_sink(serial_console_sink_t sink) {
+  console_sink = sink;
+}
+
+// ============================================================================
+// CONSOLE
+// ============================================================================
+
+namespace {
+
+class SerialConsole : public FileHandle {
+public:
+  SerialConsole() { serial_port_init(SERIAL_CONSOLE_BAUD); }
+
+  ssize_t write(const void *buffer, size_t size) override {
+    serial_console_sink_t sink = console_sink;
+    if (sink != nullptr) {
+      sink(buffer, size);
+      return size;
+    }
+    const uint8_t *p = (const uint8_t *)buffer;
+    if (!core_util_are_interrupts_enabled()) {
+      write_polled(p, size);
+      return size;
+    }
+    size_t left = size;
+    while (left > 0) {
+      size_t n = serial_port_write(p, left, false);
+      p += n;
+      left -= n;
+      if (n == 0) {
+        if (core_util_is_isr_active())
+          break; // ISRs get what fits
+        ThisThread::sleep_for(1ms);
+      }
+    }
+    return size - left;
+  }
+
+  ssize_t read(void *buffer, size_t size) override {
+    size_t n = serial_port_read(buffer, size);
+    return n > 0 ? (ssize_t)n : -EAGAIN;
+  }
+  off_t seek(off_t offset, int whence) override { return -ESPIPE; }
+  int close() override { return 0; }
+  int isatty() override { return 1; }
+};
+
+} // namespace
+
+namespace mbed {
+FileHandle *mbed_override_console(int fd) {
+  static SerialConsole console;
+  return &console;
+}
+} // namespace mbed
@@ -0,0 +1,103 @@
+/**
+ * @file shell.cpp
+ * @brief Serial command shell (see shell.h)
+ */
+
+#include "shell.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "serial_port.h"
+
+static const ShellCommand *command_table = nullptr;
+static size_t command_count = 0;
+
+static char line[SHELL_LINE_MAX];
+static size_t line_len = 0;
+static bool line_overflow = false; // discard until the end of the line
+static char last_eol = 0;
+
+static void print_help() {
+  printf("Commands:\n");
+  for (size_t i = 0; i < command_count; i++) {
+    const ShellCommand &c = command_table[i];
+    printf("  %-8s %-24s %s\n", c.name, c.usage, c.help);
+  }
+  printf("  %-8s %-24s %s\n", "help", "", "this list");
+}
+
+static void run_line() {
+  char *argv[SHELL_MAX_ARGS];
+  int argc = 0;
+  char *save = nullptr;
+  for (char *tok = strtok_r(line, " \t", &save); tok != nullptr;
+       tok = strtok_r(nullptr, " \t", &save)) {
+    if (argc == SHELL_MAX_ARGS) {
+      printf("too many arguments\n");
+      return;
+    }
+    argv[argc++] = tok;
+  }
+  if (argc == 0)
+    return;
+
+  if (strcmp(argv[0], "help") == 0) {
+    print_help();
+    return;
+  }
+  for (size_t i = 0; i < command_count; i++) {
+    if (strcmp(argv[0], command_table[i].name) == 0) {
+      command_table[i].run(argc, argv);
+      return;
+    }
+  }
+  printf("unknown command '%s', try help\n", argv[0]);
+}
+
+void shell_init(const ShellCommand *commands, size_t count) {
+  command_table = commands;
+  command_count = count;
+}
+
+void shell_poll() {
+  char in[16];
+  size_t n;
+  while ((n = serial_port_read(in, sizeof(in))) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      char c = in[i];
+      if (c == '\r' || c == '\n') {
+        // CR LF (or LF CR) ends one line, not two.
+        bool pair = last_eol != 0 && last_eol != c;
+        last_eol = pair ? 0 : c;
+        if (pair)
+          continue;
+        printf("\n");
+        if (line_overflow)
+          printf("line too long\n");
+        else if (line_len > 0) {
+          line[line_len] = '\0';
+          run_line();
+        }
+        line_len = 0;
+        line_overflow = false;
+        printf("> ");
+        continue;
+      }
+      last_eol = 0;
+      if (c == '\b' || c == 0x7F) {
+        if (line_len > 0) {
+          line_len--;
+          printf("\b \b");
+        }
+      } else if (c >= ' ' && c < 0x7F) {
+        if (line_len + 1 < sizeof(line))
+          line[line_len++] = c;
+        else
+          line_overflow = true;
+        putchar(c);
+      }
+    }
+    fflush(stdout);
+  }
+}
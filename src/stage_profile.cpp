@@ -0,0 +1,60 @@
+/**
+ * @file stage_profile.cpp
+ * @brief Stage cycle statistics (see stage_profile.h)
+ */
+
+#include "stage_profile.h"
+
+#include "mbed.h"
+
+#if STAGE_PROFILE_ENABLE
+
+struct StageStats {
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint64_t sum_cycles;
+};
+
+static StageStats stages[STAGE_COUNT] = {};
+
+void stage_profile_add(uint8_t stage, uint32_t cycles) {
+  StageStats &s = stages[stage];
+  core_util_critical_section_enter();
+  if (s.count == 0 || cycles < s.min_cycles)
+    s.min_cycles = cycles;
+  if (cycles > s.max_cycles)
+    s.max_cycles = cycles;
+  s.sum_cycles += cycles;
+  s.count++;
+  core_util_critical_section_exit();
+}
+
+void stage_profile_get(uint8_t stage, StageSnapshot *out) {
+  core_util_critical_section_enter();
+  StageStats s = stages[stage];
+  core_util_critical_section_exit();
+  out->count = s.count;
+  out->min_cycles = s.min_cycles;
+  out->max_cycles = s.max_cycles;
+  out->mean_cycles = s.count ? (uint32_t)(s.sum_cycles / s.count) : 0;
+}
+
+#endif // STAGE_PROFILE_ENABLE
+
+const char *stage_profile_name(uint8_t stage) {
+  switch (stage) {
+  case STAGE_READ:
+    return "read";
+  case STAGE_CONVERT:
+    return "convert";
+  case STAGE_FORMAT:
+    return "format";
+  case STAGE_PUBLISH:
+    return "publish";
+  case STAGE_EXT_PAGE:
+    return "ext_page";
+  default:
+    return "?";
+  }
+}
@@ -0,0 +1,211 @@
+/**
+ * @file supervisor.cpp
+ * @brief IWDG supervisor and backup-register reset record (STM32F446)
+ *
+ * Backup register layout (written from the poll ISR only):
+ *   BKP16R  magic << 16 | boot count
+ *   BKP17R  missed channel mask
+ *   BKP18R  uptime in ms at the last poll
+ *   BKP19R  i2c check-in age << 16 | acq check-in age (ms, saturated)
+ *
+ * The registers sit in the backup domain: writes need the PWR clock and
+ * PWR_CR.DBP, reads work regardless.
+ */
+
+#include "supervisor.h"
+
+#include "mbed.h"
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+#define RECORD_MAGIC 0x5D1EU
+#define REG_BOOT RTC->BKP16R
+#define REG_MISSED RTC->BKP17R
+#define REG_UPTIME RTC->BKP18R
+#define REG_AGES RTC->BKP19R
+
+// IWDG runs from the ~32 kHz LSI; /256 gives 8 ms per reload count.
+#define IWDG_KEY_ACCESS 0x5555U
+#define IWDG_KEY_RELOAD 0xAAAAU
+#define IWDG_PR_DIV256 6U
+#define IWDG_DIV256_TICK_MS 8U
+#define IWDG_RLR_MAX 0x0FFFU
+
+// ============================================================================
+// STATE
+// ============================================================================
+
+static const uint32_t deadline_us[SUPERVISOR_CH_COUNT] = {
+    SUPERVISOR_ACQ_DEADLINE_MS * 1000U, SUPERVISOR_I2C_DEADLINE_MS * 1000U};
+
+static volatile uint32_t last_check_in_us[SUPERVISOR_CH_COUNT] = {};
+static uint32_t enabled_mask = 0;
+static volatile bool suspended = false;
+static uint32_t saved_pr = 0;
+static uint32_t saved_rlr = 0;
+static uint32_t missed_mask = 0;
+static uint32_t last_poll_us = 0;
+static uint64_t uptime_us = 0;
+
+static SupervisorRecord previous = {};
+static Ticker poll_ticker;
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+static uint8_t read_reset_reason() {
+  switch (ResetReason::get()) {
+  case RESET_REASON_POWER_ON:
+    return SUPERVISOR_RESET_POWER_ON;
+  case RESET_REASON_PIN_RESET:
+    return SUPERVISOR_RESET_PIN;
+  case RESET_REASON_SOFTWARE:
+    return SUPERVISOR_RESET_SOFTWARE;
+  case RESET_REASON_WATCHDOG:
+    return SUPERVISOR_RESET_WATCHDOG;
+  case RESET_REASON_BROWN_OUT:
+    return SUPERVISOR_RESET_BROWN_OUT;
+  default:
+    return SUPERVISOR_RESET_OTHER;
+  }
+}
+
+static void iwdg_reconfigure(uint32_t pr, uint32_t rlr) {
+  IWDG->KR = IWDG_KEY_ACCESS;
+  while (IWDG->SR != 0) {
+  }
+  IWDG->PR = pr;
+  IWDG->RLR = rlr;
+  while (IWDG->SR != 0) {
+  }
+  IWDG->KR = IWDG_KEY_RELOAD;
+}
+
+static void restart_deadlines() {
+  uint32_t now = us_ticker_read();
+  for (uint8_t ch = 0; ch < SUPERVISOR_CH_COUNT; ch++)
+    last_check_in_us[ch] = now;
+}
+
+static inline uint16_t saturate_ms(uint32_t us) {
+  uint32_t ms = us / 1000U;
+  return (uint16_t)(ms > 0xFFFFU ? 0xFFFFU : ms);
+}
+
+// Ticker ISR: refresh the record, then kick only if every channel is alive.
+static void supervisor_poll() {
+  uint32_t now = us_ticker_read();
+  uptime_us += now - last_poll_us;
+  last_poll_us = now;
+
+  if (suspended)
+    return; // IWDG runs with the long timeout, deadlines are paused
+
+  uint32_t ages_us[SUPERVISOR_CH_COUNT];
+  for (uint8_t ch = 0; ch < SUPERVISOR_CH_COUNT; ch++) {
+    ages_us[ch] = now - last_check_in_us[ch];
+    if ((enabled_mask & (1UL << ch)) && ages_us[ch] > deadline_us[ch])
+      missed_mask |= 1UL << ch;
+  }
+
+  REG_MISSED = missed_mask;
+  REG_UPTIME = (uint32_t)(uptime_us / 1000U);
+  REG_AGES = (uint32_t)saturate_ms(ages_us[SUPERVISOR_CH_I2C]) << 16 |
+             saturate_ms(ages_us[SUPERVISOR_CH_ACQ]);
+
+  // Sticky: once a channel missed, the IWDG is left to expire.
+  if (missed_mask == 0)
+    Watchdog::get_instance().kick();
+}
+
+// ============================================================================
+// PUBLIC API
+// ============================================================================
+
+void supervisor_init() {
+  previous.reset_reason = read_reset_reason();
+
+  uint32_t boot = REG_BOOT;
+  previous.valid = (boot >> 16) == RECORD_MAGIC;
+  if (previous.valid) {
+    previous.boot_count = (uint16_t)boot;
+    previous.missed_mask = (uint8_t)REG_MISSED;
+    previous.uptime_ms = REG_UPTIME;
+    uint32_t ages = REG_AGES;
+    previous.age_ms[SUPERVISOR_CH_ACQ] = (uint16_t)ages;
+    previous.age_ms[SUPERVISOR_CH_I2C] = (uint16_t)(ages >> 16);
+  }
+
+  __HAL_RCC_PWR_CLK_ENABLE();
+  PWR->CR |= PWR_CR_DBP;
+
+  uint16_t boots = previous.valid ? (uint16_t)(previous.boot_count + 1) : 1;
+  REG_BOOT = (uint32_t)RECORD_MAGIC << 16 | boots;
+  REG_MISSED = 0;
+  REG_UPTIME = 0;
+  REG_AGES = 0;
+}
+
+void supervisor_start(uint32_t channel_mask) {
+  restart_deadlines();
+  last_poll_us = us_ticker_read();
+  enabled_mask = channel_mask;
+
+  // Keep a debugger halt from turning into a watchdog reset.
+  DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+  Watchdog::get_instance().start(SUPERVISOR_WDG_TIMEOUT_MS);
+  poll_ticker.attach(supervisor_poll,
+                     std::chrono::milliseconds(SUPERVISOR_POLL_MS));
+}
+
+void supervisor_suspend(uint32_t max_ms) {
+  if (enabled_mask == 0)
+    return; // not started, nothing to stretch
+  uint32_t rlr = max_ms / IWDG_DIV256_TICK_MS + 1U;
+  if (rlr > IWDG_RLR_MAX)
+    rlr = IWDG_RLR_MAX;
+
+  core_util_critical_section_enter();
+  suspended = true;
+  saved_pr = IWDG->PR;
+  saved_rlr = IWDG->RLR;
+  iwdg_reconfigure(IWDG_PR_DIV256, rlr);
+  core_util_critical_section_exit();
+}
+
+void supervisor_resume() {
+  if (!suspended)
+    return;
+  core_util_critical_section_enter();
+  iwdg_reconfigure(saved_pr, saved_rlr);
+  restart_deadlines();
+  suspended = false;
+  core_util_critical_section_exit();
+}
+
+void supervisor_check_in(uint8_t channel) {
+  if (channel < SUPERVISOR_CH_COUNT)
+    last_check_in_us[channel] = us_ticker_read();
+}
+
+const SupervisorRecord &supervisor_previous() { return previous; }
+
+const char *supervisor_reset_name(uint8_t reason) {
+  switch (reason) {
+  case SUPERVISOR_RESET_POWER_ON:
+    return "power-on";
+  case SUPERVISOR_RESET_PIN:
+    return "pin";
+  case SUPERVISOR_RESET_SOFTWARE:
+    return "software";
+  case SUPERVISOR_RESET_WATCHDOG:
+    return "watchdog";
+  case SUPERVISOR_RESET_BROWN_OUT:
+    return "brown-out";
+  default:
+    return "other";
+  }
+}
@@ -0,0 +1,170 @@
+/**
+ * @file telemetry.cpp
+ * @brief Telemetry packets on the serial port (see telemetry.h)
+ */
+
+#include "telemetry.h"
+
+#include <stdio.h>
+
+#include "serial_port.h"
+#include "telemetry_frame.h"
+
+#include "mbed.h"
+
+static_assert((TELEMETRY_TEXT_RING_SIZE & (TELEMETRY_TEXT_RING_SIZE - 1)) ==
+                  0,
+              "TELEMETRY_TEXT_RING_SIZE must be a power of two");
+static_assert(sizeof(TelemStatus) <= TELEM_TEXT_MAX, "packet buffer size");
+
+#define TEXT_MASK (TELEMETRY_TEXT_RING_SIZE - 1U)
+
+static volatile bool active = false;
+static uint32_t stream_period_us = 0;
+
+// Stream state, acquisition thread only while active.
+static uint8_t packet[TELEM_OVERHEAD + TELEM_TEXT_MAX];
+static uint16_t packet_seq = 0;
+static bool status_due = false;
+static uint32_t next_status_us = 0;
+
+static volatile uint32_t samples_sent = 0;
+static volatile uint32_t samples_dropped = 0;
+static volatile uint32_t text_dropped = 0;
+
+// Console text waiting for a TEXT packet. Any thread writes (critical
+// section), the acquisition thread reads.
+static char text_ring[TELEMETRY_TEXT_RING_SIZE];
+static volatile uint32_t text_head = 0;
+static volatile uint32_t text_tail = 0;
+
+// Console sink while streaming: never waits, overflow is counted.
+static void text_sink(const void *data, size_t len) {
+  const char *p = (const char *)data;
+  while (len > 0) {
+    size_t n = len < TELEM_TEXT_MAX ? len : TELEM_TEXT_MAX;
+    core_util_critical_section_enter();
+    uint32_t space = TELEMETRY_TEXT_RING_SIZE - (text_head - text_tail);
+    size_t take = n <= space ? n : space;
+    uint32_t head = text_head;
+    for (size_t i = 0; i < take; i++)
+      text_ring[(head + i) & TEXT_MASK] = p[i];
+    text_head = head + take;
+    core_util_critical_section_exit();
+    if (take < n)
+      core_util_atomic_incr_u32(&text_dropped, n - take);
+    p += n;
+    len -= n;
+  }
+}
+
+// Copies up to @p max bytes of pending text without consuming them.
+static uint32_t text_peek(char *out, uint32_t max) {
+  uint32_t n = text_head - text_tail;
+  if (n > max)
+    n = max;
+  for (uint32_t i = 0; i < n; i++)
+    out[i] = text_ring[(text_tail + i) & TEXT_MASK];
+  return n;
+}
+
+static bool send_packet(uint8_t type, const void *payload, uint8_t len) {
+  size_t n = telem_encode(packet, type, packet_seq, payload, len);
+  if (serial_port_write(packet, n, true) != n)
+    return false;
+  packet_seq++;
+  return true;
+}
+
+void telemetry_push_sample(uint32_t cycle, uint32_t t_us, uint16_t raw1,
+                           uint16_t raw2, float mm1, float mm2,
+                           uint16_t status) {
+  if (!active)
+    return;
+
+  TelemSample s;
+  s.cycle = cycle;
+  s.t_us = t_us;
+  s.raw[0] = raw1;
+  s.raw[1] = raw2;
+  s.mm[0] = mm1;
+  s.mm[1] = mm2;
+  s.status = status;
+  if (send_packet(TELEM_TYPE_SAMPLE, &s, sizeof(s)))
+    samples_sent++;
+  else
+    samples_dropped++;
+
+  // At most one text packet per cycle; text that does not fit waits.
+  char text[TELEM_TEXT_MAX];
+  uint32_t n = text_peek(text, sizeof(text));
+  if (n > 0 && send_packet(TELEM_TYPE_TEXT, text, (uint8_t)n))
+    text_tail = text_tail + n;
+
+  if (status_due || (int32_t)(t_us - next_status_us) >= 0) {
+    TelemStatus st = {};
+    st.version = TELEM_VERSION;
+    st.baud = serial_port_baud();
+    st.period_us = stream_period_us;
+    st.samples_sent = samples_sent;
+    st.samples_dropped = samples_dropped;
+    st.text_dropped = text_dropped;
+    if (send_packet(TELEM_TYPE_STATUS, &st, sizeof(st))) {
+      status_due = false;
+      next_status_us = t_us + TELEMETRY_STATUS_PERIOD_MS * 1000U;
+    }
+  }
+}
+
+void telemetry_start(uint32_t period_us) {
+  if (active)
+    return;
+  printf("Telemetry: streaming at %lu baud\n", (unsigned long)TELEMETRY_BAUD);
+
+  stream_period_us = period_us;
+  samples_sent = 0;
+  samples_dropped = 0;
+  text_dropped = 0;
+  status_due = true;
+  core_util_critical_section_enter();
+  text_tail = text_head;
+  core_util_critical_section_exit();
+
+  // Console text queues for packets from here on; what was printed before
+  // still goes out at the console rate.
+  serial_port_set_console_sink(text_sink);
+  serial_port_set_baud(TELEMETRY_BAUD);
+  active = true;
+}
+
+void telemetry_stop() {
+  if (!active)
+    return;
+  active = false;
+  // Let a cycle that already saw the stream active finish its packets.
+  ThisThread::sleep_for(
+      std::chrono::milliseconds(stream_period_us / 1000U + 1U));
+
+  serial_port_set_baud(SERIAL_CONSOLE_BAUD);
+  serial_port_set_console_sink(nullptr);
+
+  // Text that never made it into a packet goes out as plain console text.
+  char text[TELEM_TEXT_MAX];
+  uint32_t n;
+  while ((n = text_peek(text, sizeof(text))) > 0) {
+    fwrite(text, 1, n, stdout);
+    text_tail = text_tail + n;
+  }
+  printf("Telemetry: stopped, %lu samples sent, %lu dropped\n",
+         (unsigned long)samples_sent, (unsigned long)samples_dropped);
+}
+
+bool telemetry_active() { return active; }
+
+void telemetry_get_stats(TelemetryStats *out) {
+  out->active = active;
+  out->baud = serial_port_baud();
+  out->samples_sent = samples_sent;
+  out->samples_dropped = samples_dropped;
+  out->text_dropped = text_dropped;
+}
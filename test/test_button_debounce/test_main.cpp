@@ -0,0 +1,177 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests of ButtonDebouncer (button_debounce.h)
+ *
+ * A simulated line is stepped in 100 us ticks. Every level change is an
+ * edge interrupt, and the settle timer fires BUTTON_DEBOUNCE_MS after the
+ * edge that armed it, as on main_queue in the firmware.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unity.h>
+#include <vector>
+
+#include "button_debounce.h"
+
+#define BUTTON_DEBOUNCE_MS 50
+#define TICK_US 100U
+
+// Pressed level as a list of (time, level) changes; pressed = true.
+struct SimLine {
+  std::vector<uint32_t> t_us;
+  std::vector<bool> level;
+
+  void set(uint32_t at_us, bool pressed) {
+    t_us.push_back(at_us);
+    level.push_back(pressed);
+  }
+
+  // Toggles every @p step_us for @p n changes starting at @p at_us, ending
+  // on @p final_level.
+  void bounce(uint32_t at_us, int n, uint32_t step_us, bool final_level) {
+    bool l = (n % 2 == 0) ? final_level : !final_level;
+    for (int i = 0; i < n; i++) {
+      l = !l;
+      set(at_us + (uint32_t)i * step_us, l);
+    }
+  }
+
+  bool at(uint32_t now_us) const {
+    bool l = false;
+    for (size_t i = 0; i < t_us.size() && t_us[i] <= now_us; i++)
+      l = level[i];
+    return l;
+  }
+};
+
+struct SimResult {
+  int presses;
+  int releases;
+  int timers;    // settle timers armed
+  int overlaps;  // edges that armed a timer while one was pending
+  bool settling; // still settling at the end
+};
+
+static SimResult run(const SimLine &line, uint32_t end_us) {
+  ButtonDebouncer db;
+  SimResult r = {0, 0, 0, 0, false};
+  bool last = false;
+  bool timer = false;
+  uint32_t fire_at = 0;
+  for (uint32_t t = 0; t <= end_us; t += TICK_US) {
+    bool l = line.at(t);
+    if (l != last && db.on_edge()) {
+      if (timer)
+        r.overlaps++;
+      timer = true;
+      fire_at = t + BUTTON_DEBOUNCE_MS * 1000U;
+      r.timers++;
+    }
+    last = l;
+    if (timer && t >= fire_at) {
+      timer = false;
+      ButtonEvent e = db.on_settled([&]() { return line.at(t); });
+      if (e == BUTTON_PRESSED)
+        r.presses++;
+      else if (e == BUTTON_RELEASED)
+        r.releases++;
+    }
+  }
+  r.settling = db.settling();
+  return r;
+}
+
+// One timer at a time, none left behind.
+static void check_timers(const SimResult &r) {
+  TEST_ASSERT_EQUAL_INT(0, r.overlaps);
+  TEST_ASSERT_FALSE(r.settling);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_clean_press_and_release() {
+  SimLine line;
+  line.set(10000, true);
+  line.set(300000, false);
+  SimResult r = run(line, 600000);
+  check_timers(r);
+  TEST_ASSERT_EQUAL_INT(1, r.presses);
+  TEST_ASSERT_EQUAL_INT(1, r.releases);
+}
+
+static void test_bouncing_press_gives_one_event_each_way() {
+  SimLine line;
+  line.bounce(10000, 9, 700, true);   // ~6 ms of contact bounce
+  line.bounce(400000, 7, 1300, false); // release bounces too
+  SimResult r = run(line, 800000);
+  check_timers(r);
+  TEST_ASSERT_EQUAL_INT(1, r.presses);
+  TEST_ASSERT_EQUAL_INT(1, r.releases);
+  TEST_ASSERT_EQUAL_INT(2, r.timers); // the bursts arm one timer each
+}
+
+static void test_short_glitch_is_ignored() {
+  SimLine line;
+  line.set(10000, true); // 3 ms spike, shorter than the settle time
+  line.set(13000, false);
+  line.bounce(200000, 5, 400, false); // noise burst ending released
+  SimResult r = run(line, 500000);
+  check_timers(r);
+  TEST_ASSERT_EQUAL_INT(0, r.presses);
+  TEST_ASSERT_EQUAL_INT(0, r.releases);
+}
+
+static void test_glitch_during_hold_is_ignored() {
+  SimLine line;
+  line.set(10000, true);
+  line.set(150000, false); // 2 ms dropout while held
+  line.set(152000, true);
+  line.set(400000, false);
+  SimResult r = run(line, 700000);
+  check_timers(r);
+  TEST_ASSERT_EQUAL_INT(1, r.presses);
+  TEST_ASSERT_EQUAL_INT(1, r.releases);
+}
+
+static void test_bounce_longer_than_settle_converges() {
+  // Bounces for 80 ms: the first timer may sample mid-bounce, the edges
+  // after it re-arm, and the accepted level ends pressed, once.
+  SimLine line;
+  line.bounce(10000, 41, 2000, true);
+  SimResult r = run(line, 400000);
+  check_timers(r);
+  TEST_ASSERT_EQUAL_INT(1, r.presses);
+  TEST_ASSERT_EQUAL_INT(0, r.releases);
+  TEST_ASSERT_GREATER_THAN(1, r.timers);
+}
+
+static void test_random_presses() {
+  srand(1);
+  SimLine line;
+  uint32_t t = 10000;
+  const int presses = 200;
+  for (int i = 0; i < presses; i++) {
+    // Bounce up to ~20 ms, hold and pause well above the settle time.
+    line.bounce(t, 1 + 2 * (rand() % 10), 200 + rand() % 1800, true);
+    t += 120000 + (uint32_t)(rand() % 200000);
+    line.bounce(t, 1 + 2 * (rand() % 10), 200 + rand() % 1800, false);
+    t += 120000 + (uint32_t)(rand() % 200000);
+  }
+  SimResult r = run(line, t + 100000);
+  check_timers(r);
+  TEST_ASSERT_EQUAL_INT(presses, r.presses);
+  TEST_ASSERT_EQUAL_INT(presses, r.releases);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_press_and_release);
+  RUN_TEST(test_bouncing_press_gives_one_event_each_way);
+  RUN_TEST(test_short_glitch_is_ignored);
+  RUN_TEST(test_glitch_during_hold_is_ignored);
+  RUN_TEST(test_bounce_longer_than_settle_converges);
+  RUN_TEST(test_random_presses);
+  return UNITY_END();
+}
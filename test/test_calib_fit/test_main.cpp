@@ -0,0 +1,157 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests of calib_fit() (calib_fit.h)
+ *
+ * Points are sampled from known curves over a typical raw range, so exact
+ * fits must reproduce the curve to float precision.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <unity.h>
+
+#include "calib_fit.h"
+
+#define TOL_MM 1e-5f
+
+typedef float (*Curve)(float raw);
+
+static float line_up(float raw) { return 1.47f + 0.0004f * raw; }
+
+static float parabola_up(float raw) {
+  float d = raw - 600.0f;
+  return 1.75f + 3e-4f * d + 2e-7f * d * d;
+}
+
+static float parabola_down(float raw) {
+  float d = raw - 600.0f;
+  return 1.75f - 5e-4f * d + 1e-7f * d * d;
+}
+
+// Turns inside the data: not monotonic.
+static float valley(float raw) {
+  float d = raw - 600.0f;
+  return 1.6f + 1e-6f * d * d;
+}
+
+// Points at raw = first, first + step, ...
+static uint8_t sample(Curve f, uint16_t first, uint16_t step, uint8_t n,
+                      CalibFitPoint *pts) {
+  for (uint8_t i = 0; i < n; i++) {
+    pts[i].raw = (uint16_t)(first + i * step);
+    pts[i].mm = f((float)pts[i].raw);
+  }
+  return n;
+}
+
+// The fit matches @p f at and between the points.
+static void check_exact(const CalibFitResult &r, Curve f, uint16_t lo,
+                        uint16_t hi) {
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_OK, r.status);
+  for (uint16_t raw = lo; raw <= hi; raw += 50)
+    TEST_ASSERT_FLOAT_WITHIN(TOL_MM, f((float)raw),
+                             calib_fit_eval(r, (float)raw));
+  TEST_ASSERT_TRUE(r.rms_mm < TOL_MM);
+  TEST_ASSERT_TRUE(r.max_abs_mm < TOL_MM);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, r.r2);
+  TEST_ASSERT_EQUAL_UINT16(lo, r.raw_min);
+  TEST_ASSERT_EQUAL_UINT16(hi, r.raw_max);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_exact_degree_1() {
+  CalibFitPoint pts[CALIB_FIT_MAX_POINTS];
+  CalibFitResult r;
+  uint8_t n = sample(line_up, 0, 200, 7, pts);
+  calib_fit(pts, n, 1, &r);
+  check_exact(r, line_up, 0, 1200);
+  TEST_ASSERT_EQUAL_UINT8(1, r.degree);
+  TEST_ASSERT_EQUAL_UINT8(7, r.count);
+  TEST_ASSERT_FLOAT_WITHIN(1e-8f, 0.0004f, r.coeff[1]);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, r.coeff[2]);
+}
+
+static void test_exact_degree_2() {
+  CalibFitPoint pts[CALIB_FIT_MAX_POINTS];
+  CalibFitResult r;
+  uint8_t n = sample(parabola_up, 0, 100, 13, pts);
+  calib_fit(pts, n, 2, &r);
+  check_exact(r, parabola_up, 0, 1200);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9f, 2e-7f, r.coeff[2]);
+}
+
+static void test_decreasing_curve() {
+  CalibFitPoint pts[CALIB_FIT_MAX_POINTS];
+  CalibFitResult r;
+  uint8_t n = sample(parabola_down, 100, 150, 8, pts);
+  calib_fit(pts, n, 2, &r);
+  check_exact(r, parabola_down, 100, 1150);
+  TEST_ASSERT_TRUE(r.coeff[1] < 0.0f);
+}
+
+static void test_residuals_of_a_noisy_point() {
+  CalibFitPoint pts[CALIB_FIT_MAX_POINTS];
+  CalibFitResult r;
+  uint8_t n = sample(line_up, 0, 100, 11, pts);
+  pts[5].mm += 0.011f; // 11 points: a line through the rest moves 1 um
+  calib_fit(pts, n, 1, &r);
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_OK, r.status);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.010f, r.residual[5]);
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.010f, r.max_abs_mm);
+  TEST_ASSERT_TRUE(r.r2 < 1.0f && r.r2 > 0.99f);
+  float sum = 0.0f;
+  for (uint8_t i = 0; i < n; i++)
+    sum += r.residual[i];
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 0.0f, sum); // least squares with c0
+}
+
+static void test_duplicate_raw_values_are_singular() {
+  CalibFitPoint pts[4] = {{500, 1.6f}, {500, 1.7f}, {500, 1.8f}, {500, 1.9f}};
+  CalibFitResult r;
+  calib_fit(pts, 4, 1, &r);
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_SINGULAR, r.status);
+
+  // Two distinct values cannot pin a parabola.
+  CalibFitPoint two[4] = {{100, 1.5f}, {100, 1.5f}, {900, 2.0f}, {900, 2.0f}};
+  calib_fit(two, 4, 2, &r);
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_SINGULAR, r.status);
+}
+
+static void test_non_monotonic_fit_is_rejected() {
+  CalibFitPoint pts[CALIB_FIT_MAX_POINTS];
+  CalibFitResult r;
+  uint8_t n = sample(valley, 0, 100, 13, pts);
+  calib_fit(pts, n, 2, &r);
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_NOT_MONOTONIC, r.status);
+
+  // The same curve on one side of its turning point is fine.
+  n = sample(valley, 700, 50, 9, pts);
+  calib_fit(pts, n, 2, &r);
+  check_exact(r, valley, 700, 1100);
+}
+
+static void test_bad_degree_and_too_few_points() {
+  CalibFitPoint pts[CALIB_FIT_MAX_POINTS];
+  CalibFitResult r;
+  uint8_t n = sample(line_up, 0, 100, 3, pts);
+  calib_fit(pts, n, 0, &r);
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_BAD_DEGREE, r.status);
+  calib_fit(pts, n, 3, &r);
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_BAD_DEGREE, r.status);
+  calib_fit(pts, n, 2, &r); // needs degree + 2 points
+  TEST_ASSERT_EQUAL_INT(CALIB_FIT_TOO_FEW, r.status);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_degree_1);
+  RUN_TEST(test_exact_degree_2);
+  RUN_TEST(test_decreasing_curve);
+  RUN_TEST(test_residuals_of_a_noisy_point);
+  RUN_TEST(test_duplicate_raw_values_are_singular);
+  RUN_TEST(test_non_monotonic_fit_is_rejected);
+  RUN_TEST(test_bad_degree_and_too_few_points);
+  return UNITY_END();
+}
@@ -0,0 +1,73 @@
+/**
+ * @file calib_sim_flash.h
+ * @brief RAM flash backend for host tests of CalibStore
+ *
+ * Programming can only clear bits. power_cut_after(n) makes the backend
+ * stop (and fail) after n more bytes, leaving the partially written data
+ * behind. An erase costs one byte of that budget per erased byte and runs
+ * from the start of the sector, so a cut can also leave a sector partially
+ * erased.
+ */
+
+#ifndef CALIB_SIM_FLASH_H
+#define CALIB_SIM_FLASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+template <uint32_t SectorSize> class CalibSimFlash {
+public:
+  CalibSimFlash() : budget_(-1), erases_(0) {
+    memset(mem_, 0xFF, sizeof(mem_));
+  }
+
+  uint32_t sector_size() const { return SectorSize; }
+
+  bool read(uint8_t sector, uint32_t offset, void *buf, uint32_t len) {
+    if (sector > 1 || offset + len > SectorSize)
+      return false;
+    memcpy(buf, &mem_[sector][offset], len);
+    return true;
+  }
+
+  bool program(uint8_t sector, uint32_t offset, const void *buf,
+               uint32_t len) {
+    if (sector > 1 || offset + len > SectorSize)
+      return false;
+    const uint8_t *p = (const uint8_t *)buf;
+    for (uint32_t i = 0; i < len; i++) {
+      if (budget_ == 0)
+        return false;
+      if (budget_ > 0)
+        budget_--;
+      mem_[sector][offset + i] &= p[i];
+    }
+    return true;
+  }
+
+  bool erase(uint8_t sector) {
+    if (sector > 1)
+      return false;
+    erases_++;
+    if (budget_ >= 0 && (uint32_t)budget_ < SectorSize) {
+      memset(mem_[sector], 0xFF, (uint32_t)budget_);
+      budget_ = 0;
+      return false;
+    }
+    if (budget_ > 0)
+      budget_ -= (int32_t)SectorSize;
+    memset(mem_[sector], 0xFF, SectorSize);
+    return true;
+  }
+
+  void power_cut_after(int32_t bytes) { budget_ = bytes; }
+  void power_restore() { budget_ = -1; }
+  uint32_t erases() const { return erases_; }
+
+private:
+  uint8_t mem_[2][SectorSize];
+  int32_t budget_; // bytes left before the simulated cut, -1 = unlimited
+  uint32_t erases_;
+};
+
+#endif // CALIB_SIM_FLASH_H
@@ -0,0 +1,212 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests of CalibStore (calib_store.h)
+ *
+ * Runs on small simulated sectors so that a few thousand saves go through
+ * many sector switches. The power-cut test cuts at random points of saves
+ * and erases (inline or ahead of time), reboots (a fresh mount) and checks
+ * that the loader returns the last record whose save completed.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "calib_sim_flash.h"
+#include "calib_store.h"
+
+#define SIM_SECTOR_SIZE 4096U
+#define PAYLOAD_LEN 118U
+#define PAYLOAD_FORMAT 1
+#define POWER_CUT_SAVES 20000
+
+typedef CalibSimFlash<SIM_SECTOR_SIZE> SimFlash;
+typedef CalibStore<SimFlash> Store;
+
+static void fill_payload(uint8_t *p, uint32_t n) {
+  for (uint32_t i = 0; i < PAYLOAD_LEN; i++)
+    p[i] = (uint8_t)(rand() ^ n);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_blank_flash_has_no_record() {
+  static SimFlash flash;
+  Store store(flash);
+  uint8_t buf[PAYLOAD_LEN];
+  TEST_ASSERT_FALSE(store.mount());
+  TEST_ASSERT_FALSE(store.load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+}
+
+static void test_save_and_load_after_remount() {
+  static SimFlash flash;
+  uint8_t saved[PAYLOAD_LEN], buf[PAYLOAD_LEN];
+  fill_payload(saved, 1);
+  {
+    Store store(flash);
+    store.mount();
+    TEST_ASSERT_TRUE(store.save(PAYLOAD_FORMAT, saved, PAYLOAD_LEN));
+  }
+  Store store(flash);
+  TEST_ASSERT_TRUE(store.mount());
+  TEST_ASSERT_TRUE(store.load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  TEST_ASSERT_EQUAL_MEMORY(saved, buf, PAYLOAD_LEN);
+  TEST_ASSERT_EQUAL_UINT32(1, store.seq());
+}
+
+static void test_load_rejects_other_format_or_length() {
+  static SimFlash flash;
+  Store store(flash);
+  uint8_t buf[PAYLOAD_LEN];
+  fill_payload(buf, 2);
+  store.mount();
+  TEST_ASSERT_TRUE(store.save(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  TEST_ASSERT_FALSE(store.load(PAYLOAD_FORMAT + 1, buf, PAYLOAD_LEN));
+  TEST_ASSERT_FALSE(store.load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN - 2));
+}
+
+static void test_newest_record_wins_across_sector_switches() {
+  static SimFlash flash;
+  Store store(flash);
+  uint8_t saved[PAYLOAD_LEN], buf[PAYLOAD_LEN];
+  uint32_t per_sector = SIM_SECTOR_SIZE / Store::record_size(PAYLOAD_LEN);
+  uint32_t saves = 5 * per_sector + 3;
+  store.mount();
+  for (uint32_t n = 1; n <= saves; n++) {
+    fill_payload(saved, n);
+    TEST_ASSERT_TRUE(store.save(PAYLOAD_FORMAT, saved, PAYLOAD_LEN));
+  }
+  TEST_ASSERT_EQUAL_UINT32(4, store.erases()); // the blank spare needs none
+
+  Store again(flash);
+  TEST_ASSERT_TRUE(again.mount());
+  TEST_ASSERT_EQUAL_UINT32(saves, again.seq());
+  TEST_ASSERT_TRUE(again.load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  TEST_ASSERT_EQUAL_MEMORY(saved, buf, PAYLOAD_LEN);
+}
+
+static void test_pre_erased_spare_saves_without_erase() {
+  static SimFlash flash;
+  Store store(flash);
+  uint8_t buf[PAYLOAD_LEN];
+  uint32_t per_sector = SIM_SECTOR_SIZE / Store::record_size(PAYLOAD_LEN);
+  store.mount();
+  // Both sectors full; the first one is the dirty spare.
+  for (uint32_t n = 1; n <= 2 * per_sector; n++) {
+    fill_payload(buf, n);
+    TEST_ASSERT_FALSE(store.save_erases(PAYLOAD_LEN));
+    TEST_ASSERT_TRUE(store.save(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  }
+  TEST_ASSERT_TRUE(store.spare_dirty());
+  TEST_ASSERT_TRUE(store.save_erases(PAYLOAD_LEN));
+  TEST_ASSERT_TRUE(store.erase_spare());
+  TEST_ASSERT_FALSE(store.spare_dirty());
+  TEST_ASSERT_FALSE(store.save_erases(PAYLOAD_LEN));
+  uint32_t erases = flash.erases();
+
+  // A remount finds the spare blank too.
+  Store again(flash);
+  again.mount();
+  TEST_ASSERT_FALSE(again.spare_dirty());
+  TEST_ASSERT_TRUE(again.save(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  TEST_ASSERT_EQUAL_UINT32(erases, flash.erases());
+  TEST_ASSERT_TRUE(again.spare_dirty());
+}
+
+static void test_failed_switch_keeps_newest_sector() {
+  static SimFlash flash;
+  Store store(flash);
+  uint8_t saved[PAYLOAD_LEN], buf[PAYLOAD_LEN];
+  uint32_t per_sector = SIM_SECTOR_SIZE / Store::record_size(PAYLOAD_LEN);
+  store.mount();
+  for (uint32_t n = 1; n <= per_sector; n++) {
+    fill_payload(saved, n);
+    TEST_ASSERT_TRUE(store.save(PAYLOAD_FORMAT, saved, PAYLOAD_LEN));
+  }
+
+  // The first record in the other sector fails halfway through.
+  fill_payload(buf, 0);
+  flash.power_cut_after(sizeof(CalibRecordHeader) + 5);
+  TEST_ASSERT_FALSE(store.save(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  flash.power_restore();
+
+  // No remount: the torn sector is the spare, the full one still loads.
+  TEST_ASSERT_EQUAL_UINT8(0, store.active_sector());
+  TEST_ASSERT_TRUE(store.spare_dirty());
+  TEST_ASSERT_TRUE(store.erase_spare());
+  TEST_ASSERT_TRUE(store.load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  TEST_ASSERT_EQUAL_MEMORY(saved, buf, PAYLOAD_LEN);
+
+  // The retry switches sectors and survives a remount.
+  fill_payload(saved, per_sector + 1);
+  TEST_ASSERT_TRUE(store.save(PAYLOAD_FORMAT, saved, PAYLOAD_LEN));
+  TEST_ASSERT_EQUAL_UINT8(1, store.active_sector());
+  Store again(flash);
+  TEST_ASSERT_TRUE(again.mount());
+  TEST_ASSERT_TRUE(again.load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+  TEST_ASSERT_EQUAL_MEMORY(saved, buf, PAYLOAD_LEN);
+}
+
+static void test_power_cut_keeps_last_complete_record() {
+  static SimFlash flash;
+  uint8_t payload[PAYLOAD_LEN], last[PAYLOAD_LEN], buf[PAYLOAD_LEN];
+  bool have_last = false;
+  uint32_t cuts = 0, lost = 0;
+  int32_t record = (int32_t)Store::record_size(PAYLOAD_LEN);
+  srand(1);
+
+  Store *store = new Store(flash);
+  store->mount();
+  for (uint32_t n = 1; n <= POWER_CUT_SAVES; n++) {
+    fill_payload(payload, n);
+    bool idle_erase = rand() % 16 == 0;
+    bool cut = rand() % 4 == 0;
+    if (cut) {
+      // Mostly within the record, sometimes far enough to reach into an
+      // erase of the other sector.
+      int32_t span = rand() % 8 ? 2 * record : SIM_SECTOR_SIZE + record;
+      flash.power_cut_after(rand() % span);
+    }
+
+    if (idle_erase)
+      store->erase_spare();
+    if (store->save(PAYLOAD_FORMAT, payload, PAYLOAD_LEN)) {
+      memcpy(last, payload, PAYLOAD_LEN);
+      have_last = true;
+    } else {
+      lost++;
+    }
+    if (!cut)
+      continue;
+
+    // Reboot.
+    cuts++;
+    flash.power_restore();
+    delete store;
+    store = new Store(flash);
+    TEST_ASSERT_EQUAL(have_last, store->mount());
+    if (have_last) {
+      TEST_ASSERT_TRUE(store->load(PAYLOAD_FORMAT, buf, PAYLOAD_LEN));
+      TEST_ASSERT_EQUAL_MEMORY(last, buf, PAYLOAD_LEN);
+    }
+  }
+  delete store;
+
+  TEST_ASSERT_GREATER_THAN(1000U, cuts);
+  TEST_ASSERT_GREATER_THAN(100U, lost);
+  TEST_ASSERT_GREATER_THAN(100U, flash.erases());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_flash_has_no_record);
+  RUN_TEST(test_save_and_load_after_remount);
+  RUN_TEST(test_load_rejects_other_format_or_length);
+  RUN_TEST(test_newest_record_wins_across_sector_switches);
+  RUN_TEST(test_pre_erased_spare_saves_without_erase);
+  RUN_TEST(test_failed_switch_keeps_newest_sector);
+  RUN_TEST(test_power_cut_keeps_last_complete_record);
+  return UNITY_END();
+}
@@ -0,0 +1,144 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests of FramePublisher (frame_publisher.h)
+ *
+ * Besides the single-threaded slot handover, a writer thread publishes
+ * numbered frames as fast as it can while a reader thread acquires
+ * concurrently; every frame the reader gets must be one the writer
+ * completed, and newer than or equal to the previous one.
+ */
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <unity.h>
+
+#include "frame_publisher.h"
+
+#define FRAME_LEN 64
+#define STRESS_FRAMES 2000000U
+
+typedef FramePublisher<FRAME_LEN> Publisher;
+
+// Frame @p seq: the sequence number in bytes 0..3, then a pattern derived
+// from it, so a frame mixed from two writes does not check out.
+static void fill_frame(uint8_t *f, uint32_t seq) {
+  memcpy(f, &seq, sizeof(seq));
+  for (uint32_t i = sizeof(seq); i < FRAME_LEN; i++)
+    f[i] = (uint8_t)(seq * 31U + i);
+}
+
+static bool frame_ok(const uint8_t *f, uint32_t *seq) {
+  memcpy(seq, f, sizeof(*seq));
+  for (uint32_t i = sizeof(*seq); i < FRAME_LEN; i++)
+    if (f[i] != (uint8_t)(*seq * 31U + i))
+      return false;
+  return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_initial_frame_is_zero() {
+  static Publisher pub;
+  const uint8_t *f = pub.acquire();
+  for (int i = 0; i < FRAME_LEN; i++)
+    TEST_ASSERT_EQUAL_UINT8(0, f[i]);
+  TEST_ASSERT_EQUAL_UINT32(0, pub.published_count());
+}
+
+static void test_reader_gets_newest_frame() {
+  static Publisher pub;
+  uint32_t seq;
+  for (uint32_t s = 1; s <= 3; s++) {
+    fill_frame(pub.write_buffer(), s);
+    pub.publish();
+  }
+  TEST_ASSERT_TRUE(frame_ok(pub.acquire(), &seq));
+  TEST_ASSERT_EQUAL_UINT32(3, seq);
+  TEST_ASSERT_EQUAL_UINT32(3, pub.published_count());
+}
+
+static void test_acquired_frame_stays_until_next_acquire() {
+  static Publisher pub;
+  uint32_t seq;
+  fill_frame(pub.write_buffer(), 1);
+  pub.publish();
+  const uint8_t *held = pub.acquire();
+
+  // The writer cycles through the other two slots only.
+  for (uint32_t s = 2; s < 10; s++) {
+    TEST_ASSERT_TRUE(pub.write_buffer() != held);
+    fill_frame(pub.write_buffer(), s);
+    pub.publish();
+  }
+  TEST_ASSERT_TRUE(frame_ok(held, &seq));
+  TEST_ASSERT_EQUAL_UINT32(1, seq);
+
+  TEST_ASSERT_TRUE(frame_ok(pub.acquire(), &seq));
+  TEST_ASSERT_EQUAL_UINT32(9, seq);
+}
+
+static void test_acquire_without_publish_keeps_frame() {
+  static Publisher pub;
+  uint32_t seq;
+  fill_frame(pub.write_buffer(), 7);
+  pub.publish();
+  const uint8_t *first = pub.acquire();
+  TEST_ASSERT_EQUAL_PTR(first, pub.acquire());
+  TEST_ASSERT_TRUE(frame_ok(first, &seq));
+  TEST_ASSERT_EQUAL_UINT32(7, seq);
+}
+
+static void test_concurrent_writer_and_reader() {
+  static Publisher pub;
+  std::atomic<bool> done(false);
+  uint32_t torn = 0, backwards = 0, reads = 0, distinct = 0;
+  fill_frame(pub.write_buffer(), 0); // what the reader may see first
+  pub.publish();
+
+  std::thread reader([&]() {
+    uint32_t last = 0;
+    bool stop = false;
+    while (!stop) {
+      // One last pass after the writer finished sees the final frame.
+      stop = done.load(std::memory_order_acquire);
+      uint32_t seq;
+      if (!frame_ok(pub.acquire(), &seq))
+        torn++;
+      else if (seq < last)
+        backwards++;
+      else if (seq != last)
+        distinct++;
+      last = seq > last ? seq : last;
+      reads++;
+    }
+  });
+
+  for (uint32_t s = 1; s <= STRESS_FRAMES; s++) {
+    fill_frame(pub.write_buffer(), s);
+    pub.publish();
+  }
+  done.store(true, std::memory_order_release);
+  reader.join();
+
+  uint32_t seq;
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, backwards);
+  TEST_ASSERT_GREATER_THAN(1U, distinct);
+  TEST_ASSERT_GREATER_THAN(1U, reads);
+  TEST_ASSERT_EQUAL_UINT32(STRESS_FRAMES + 1U, pub.published_count());
+  TEST_ASSERT_TRUE(frame_ok(pub.acquire(), &seq));
+  TEST_ASSERT_EQUAL_UINT32(STRESS_FRAMES, seq);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_initial_frame_is_zero);
+  RUN_TEST(test_reader_gets_newest_frame);
+  RUN_TEST(test_acquired_frame_stays_until_next_acquire);
+  RUN_TEST(test_acquire_without_publish_keeps_frame);
+  RUN_TEST(test_concurrent_writer_and_reader);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests of StableCapture (stable_capture.h)
+ *
+ * Each test feeds a synthetic raw signal, one sample per acquisition
+ * cycle, until the capture finishes or gives up.
+ */
+
+#include <stdint.h>
+#include <unity.h>
+
+#include "stable_capture.h"
+
+#define LEVEL 2000
+
+// Deterministic +/-1 count noise: variance 2/3, well below
+// CAPTURE_STABLE_VAR.
+static uint16_t noisy(uint32_t i, uint16_t level) {
+  static const int8_t pattern[3] = {-1, 0, 1};
+  return (uint16_t)(level + pattern[(i * 7U) % 3U]);
+}
+
+struct Run {
+  CaptureResult result;
+  uint32_t samples;
+};
+
+template <typename Signal>
+static Run run(StableCapture &cap, Signal signal, uint32_t max_samples) {
+  Run r = {CAPTURE_RUNNING, 0};
+  while (r.result == CAPTURE_RUNNING && r.samples < max_samples)
+    r.result = cap.add(signal(r.samples++));
+  return r;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_steady_signal_settles_and_averages() {
+  static StableCapture cap;
+  Run r = run(cap, [](uint32_t i) { return noisy(i, LEVEL); },
+              CAPTURE_SETTLE_MAX + CAPTURE_SAMPLES);
+  TEST_ASSERT_EQUAL_INT(CAPTURE_DONE, r.result);
+  TEST_ASSERT_EQUAL_UINT32(CAPTURE_WINDOW, cap.settle_samples());
+  TEST_ASSERT_EQUAL_UINT32(CAPTURE_WINDOW + CAPTURE_SAMPLES, r.samples);
+  TEST_ASSERT_EQUAL_UINT32(CAPTURE_SAMPLES, cap.accepted());
+  TEST_ASSERT_EQUAL_UINT32(0, cap.rejected());
+  TEST_ASSERT_EQUAL_UINT16(LEVEL, cap.mean());
+  TEST_ASSERT_TRUE(cap.variance() < 1.0f);
+}
+
+static void test_step_settles_at_new_level() {
+  // The window fills with a restless signal, then the level steps: two
+  // samples off the window mean in a row are movement, not a spike.
+  static StableCapture cap;
+  Run r = run(cap,
+              [](uint32_t i) {
+                static const int8_t restless[3] = {-4, 0, 4};
+                if (i < 300)
+                  return (uint16_t)(LEVEL + restless[i % 3]);
+                return noisy(i, LEVEL + 80);
+              },
+              CAPTURE_SETTLE_MAX + CAPTURE_SAMPLES);
+  TEST_ASSERT_EQUAL_INT(CAPTURE_DONE, r.result);
+  TEST_ASSERT_TRUE(cap.settle_samples() > 300 + CAPTURE_WINDOW);
+  TEST_ASSERT_EQUAL_UINT32(0, cap.rejected());
+  TEST_ASSERT_EQUAL_UINT16(LEVEL + 80, cap.mean());
+}
+
+static void test_spikes_are_skipped_and_rejected() {
+  // Isolated spikes every 97 samples, both while settling and collecting.
+  static StableCapture cap;
+  Run r = run(cap,
+              [](uint32_t i) {
+                return i % 97 == 96 ? (uint16_t)(LEVEL + 300)
+                                    : noisy(i, LEVEL);
+              },
+              CAPTURE_SETTLE_MAX + CAPTURE_SAMPLES);
+  TEST_ASSERT_EQUAL_INT(CAPTURE_DONE, r.result);
+  TEST_ASSERT_EQUAL_UINT16(LEVEL, cap.mean());
+  TEST_ASSERT_TRUE(cap.rejected() >= CAPTURE_SAMPLES / 97);
+  TEST_ASSERT_EQUAL_UINT32(CAPTURE_SAMPLES, cap.accepted() + cap.rejected());
+}
+
+static void test_drifting_signal_never_settles() {
+  // One count every 4 samples: the window variance stays far above the
+  // stable bound.
+  static StableCapture cap;
+  Run r = run(cap, [](uint32_t i) { return (uint16_t)(1000 + i / 4); },
+              CAPTURE_SETTLE_MAX + 1);
+  TEST_ASSERT_EQUAL_INT(CAPTURE_UNSTABLE, r.result);
+  TEST_ASSERT_EQUAL_UINT32(CAPTURE_SETTLE_MAX, r.samples);
+  TEST_ASSERT_FALSE(cap.collecting());
+}
+
+static void test_drift_after_settling_fails_collection() {
+  // Settles, then the rod creeps away: collection rejects too much.
+  static StableCapture cap;
+  Run r = run(cap,
+              [](uint32_t i) {
+                uint32_t creep = i > CAPTURE_WINDOW ? (i - CAPTURE_WINDOW) / 8
+                                                    : 0;
+                return (uint16_t)(LEVEL + creep);
+              },
+              CAPTURE_SETTLE_MAX + CAPTURE_SAMPLES);
+  TEST_ASSERT_EQUAL_INT(CAPTURE_UNSTABLE, r.result);
+  TEST_ASSERT_TRUE(cap.collecting());
+  TEST_ASSERT_TRUE(cap.rejected() * 1000U >
+                   (uint32_t)CAPTURE_SAMPLES * CAPTURE_MAX_REJECT_PERMILLE);
+}
+
+static void test_restart_clears_previous_capture() {
+  static StableCapture cap;
+  run(cap, [](uint32_t i) { return noisy(i, LEVEL); },
+      CAPTURE_SETTLE_MAX + CAPTURE_SAMPLES);
+  cap.start();
+  TEST_ASSERT_FALSE(cap.collecting());
+  TEST_ASSERT_EQUAL_UINT32(0, cap.accepted());
+  Run r = run(cap, [](uint32_t i) { return noisy(i, LEVEL - 500); },
+              CAPTURE_SETTLE_MAX + CAPTURE_SAMPLES);
+  TEST_ASSERT_EQUAL_INT(CAPTURE_DONE, r.result);
+  TEST_ASSERT_EQUAL_UINT16(LEVEL - 500, cap.mean());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_signal_settles_and_averages);
+  RUN_TEST(test_step_settles_at_new_level);
+  RUN_TEST(test_spikes_are_skipped_and_rejected);
+  RUN_TEST(test_drifting_signal_never_settles);
+  RUN_TEST(test_drift_after_settling_fails_collection);
+  RUN_TEST(test_restart_clears_previous_capture);
+  return UNITY_END();
+}
@@ -0,0 +1,286 @@
+/**
+ * @file telemetry_decode.cpp
+ * @brief Host decoder for the binary telemetry stream (telemetry_frame.h)
+ *
+ * Reads packets from a capture file, a serial device / pty or stdin and
+ * writes the samples as CSV and/or as raw TelemSample records. Console text
+ * carried in the stream and the link counters go to stderr, a summary of
+ * checksum errors and sequence gaps follows at the end (EOF or Ctrl-C).
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++17 -O2 -Wall -Iinclude -o telemetry_decode \
+ *       tools/telemetry_decode.cpp
+ *
+ * Usage:
+ *   telemetry_decode [-b baud] [-c out.csv] [-o out.bin] [-q] <input|->
+ *     -b  set the serial rate when the input is a tty (default 1500000)
+ *     -c  CSV file ("-" or default: stdout)
+ *     -o  binary file of packed TelemSample records (22 bytes each)
+ *     -q  no console text / status lines on stderr
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "telemetry_frame.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int) { stop_requested = 1; }
+
+struct DecodeStats {
+  uint64_t bytes;
+  uint64_t skipped; // bytes outside valid packets
+  uint64_t packets;
+  uint64_t crc_errors;
+  uint64_t seq_gaps; // packets missing according to TelemHeader::seq
+  uint64_t samples;
+  uint64_t cycle_gaps; // samples missing according to TelemSample::cycle
+};
+
+struct Outputs {
+  FILE *csv;
+  FILE *bin;
+  bool quiet;
+};
+
+static speed_t baud_constant(long baud) {
+  switch (baud) {
+  case 115200:
+    return B115200;
+  case 230400:
+    return B230400;
+  case 460800:
+    return B460800;
+  case 921600:
+    return B921600;
+  case 1000000:
+    return B1000000;
+  case 1500000:
+    return B1500000;
+  case 2000000:
+    return B2000000;
+  default:
+    return 0;
+  }
+}
+
+// Raw 8N1 at @p baud; a no-op for files and pipes.
+static bool configure_tty(int fd, long baud) {
+  if (!isatty(fd))
+    return true;
+  speed_t speed = baud_constant(baud);
+  if (speed == 0) {
+    fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return false;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) {
+    perror("tcgetattr");
+    return false;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+    perror("tcsetattr");
+    return false;
+  }
+  tcflush(fd, TCIFLUSH);
+  return true;
+}
+
+static void handle_packet(const TelemHeader &h, const uint8_t *payload,
+                          const Outputs &out, DecodeStats *st) {
+  static bool have_seq = false, have_cycle = false;
+  static uint16_t last_seq = 0;
+  static uint32_t last_cycle = 0;
+
+  if (have_seq)
+    st->seq_gaps += (uint16_t)(h.seq - last_seq - 1U);
+  last_seq = h.seq;
+  have_seq = true;
+  st->packets++;
+
+  switch (h.type) {
+  case TELEM_TYPE_SAMPLE: {
+    if (h.len != sizeof(TelemSample))
+      break;
+    TelemSample s;
+    memcpy(&s, payload, sizeof(s));
+    if (have_cycle && s.cycle != last_cycle + 1U)
+      st->cycle_gaps += s.cycle - last_cycle - 1U;
+    last_cycle = s.cycle;
+    have_cycle = true;
+    st->samples++;
+    if (out.csv)
+      fprintf(out.csv, "%u,%u,%u,%u,%.5f,%.5f,0x%04X\n", s.cycle, s.t_us,
+              s.raw[0], s.raw[1], s.mm[0], s.mm[1], s.status);
+    if (out.bin)
+      fwrite(&s, sizeof(s), 1, out.bin);
+    break;
+  }
+  case TELEM_TYPE_STATUS: {
+    if (h.len != sizeof(TelemStatus) || out.quiet)
+      break;
+    TelemStatus s;
+    memcpy(&s, payload, sizeof(s));
+    fprintf(stderr,
+            "[status] v%u baud=%u period=%uus sent=%u dropped=%u "
+            "text_dropped=%u\n",
+            s.version, s.baud, s.period_us, s.samples_sent, s.samples_dropped,
+            s.text_dropped);
+    break;
+  }
+  case TELEM_TYPE_TEXT:
+    if (!out.quiet)
+      fwrite(payload, 1, h.len, stderr);
+    break;
+  default:
+    break;
+  }
+}
+
+// Decodes every complete packet in @p buf and removes the consumed bytes.
+static void decode(std::vector<uint8_t> &buf, const Outputs &out,
+                   DecodeStats *st) {
+  size_t pos = 0;
+  while (buf.size() - pos >= TELEM_OVERHEAD) {
+    const uint8_t *p = buf.data() + pos;
+    if (p[0] != TELEM_SYNC0 || p[1] != TELEM_SYNC1) {
+      pos++;
+      st->skipped++;
+      continue;
+    }
+    TelemHeader h;
+    memcpy(&h, p, sizeof(h));
+    size_t total = TELEM_OVERHEAD + h.len;
+    if (buf.size() - pos < total)
+      break; // wait for the rest
+    uint16_t crc;
+    memcpy(&crc, p + sizeof(h) + h.len, sizeof(crc));
+    if (crc != ext_crc16(p + 2, sizeof(h) - 2U + h.len)) {
+      // False sync or damaged packet: resume the search one byte later.
+      st->crc_errors++;
+      pos++;
+      st->skipped++;
+      continue;
+    }
+    handle_packet(h, p + sizeof(h), out, st);
+    pos += total;
+  }
+  buf.erase(buf.begin(), buf.begin() + pos);
+}
+
+static void usage() {
+  fprintf(stderr, "usage: telemetry_decode [-b baud] [-c out.csv] "
+                  "[-o out.bin] [-q] <input|->\n");
+}
+
+int main(int argc, char **argv) {
+  long baud = 1500000;
+  const char *csv_path = nullptr;
+  const char *bin_path = nullptr;
+  Outputs out = {nullptr, nullptr, false};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:c:o:q")) != -1) {
+    switch (opt) {
+    case 'b':
+      baud = strtol(optarg, nullptr, 10);
+      break;
+    case 'c':
+      csv_path = optarg;
+      break;
+    case 'o':
+      bin_path = optarg;
+      break;
+    case 'q':
+      out.quiet = true;
+      break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+    return 2;
+  }
+
+  const char *in_path = argv[optind];
+  int fd = strcmp(in_path, "-") == 0 ? STDIN_FILENO
+                                     : open(in_path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    perror(in_path);
+    return 1;
+  }
+  if (!configure_tty(fd, baud))
+    return 1;
+
+  if (csv_path == nullptr || strcmp(csv_path, "-") == 0) {
+    // Without -o the CSV goes to stdout; with -o only if asked for.
+    if (csv_path != nullptr || bin_path == nullptr)
+      out.csv = stdout;
+  } else if ((out.csv = fopen(csv_path, "w")) == nullptr) {
+    perror(csv_path);
+    return 1;
+  }
+  if (bin_path && (out.bin = fopen(bin_path, "wb")) == nullptr) {
+    perror(bin_path);
+    return 1;
+  }
+  if (out.csv)
+    fprintf(out.csv, "cycle,t_us,raw1,raw2,mm1,mm2,status\n");
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  DecodeStats st = {};
+  std::vector<uint8_t> buf;
+  uint8_t chunk[4096];
+  while (!stop_requested) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("read");
+      break;
+    }
+    if (n == 0)
+      break;
+    st.bytes += (uint64_t)n;
+    buf.insert(buf.end(), chunk, chunk + n);
+    decode(buf, out, &st);
+  }
+
+  if (out.csv)
+    fflush(out.csv);
+  if (out.csv && out.csv != stdout)
+    fclose(out.csv);
+  if (out.bin)
+    fclose(out.bin);
+  fprintf(stderr,
+          "%llu bytes, %llu packets, %llu samples; %llu crc errors, "
+          "%llu bytes skipped, %llu packets lost, %llu samples missing\n",
+          (unsigned long long)st.bytes, (unsigned long long)st.packets,
+          (unsigned long long)st.samples, (unsigned long long)st.crc_errors,
+          (unsigned long long)st.skipped, (unsigned long long)st.seq_gaps,
+          (unsigned long long)st.cycle_gaps);
+  return 0;
+}